@@ -0,0 +1,52 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+#include "listener.h"
+
+#ifndef ADMIT_OK
+#define ADMIT_OK 0 /* Connection was admitted. */
+#endif
+
+#ifndef ADMIT_LIMIT_TOTAL
+#define ADMIT_LIMIT_TOTAL -1 /* Global connection limit reached. */
+#endif
+
+#ifndef ADMIT_LIMIT_ADDR
+#define ADMIT_LIMIT_ADDR -2 /* Per-address connection limit reached. */
+#endif
+
+/* Opaque handle to thread-safe connection accounting, tracking the number of
+ * live connections per remote address. */
+typedef struct admission_t admission_t;
+
+/* How rejected connections are closed. */
+typedef enum {
+    ADMIT_REJECT_RST, /* Abort with a TCP reset, without sending a response. */
+    ADMIT_REJECT_503, /* Send a canned `503 Service Unavailable` and close. */
+} admit_reject_t;
+
+/* Initialize admission control allowing at most `max_total` live connections,
+ * and at most `max_per_addr` from a single remote address. IPv6 addresses
+ * sharing a /64 prefix count as a single address, and IPv4-mapped IPv6
+ * addresses count as the IPv4 address. Returns a pointer to the admission
+ * state, otherwise NULL. */
+admission_t *admission_init(uint32_t max_total, uint32_t max_per_addr);
+
+/* Frees the memory used by the admission state and its address table. */
+void admission_free(admission_t *adm);
+
+/* Account for a newly accepted connection. Returns (ADMIT_OK) if the
+ * connection may be served, which must later be paired with
+ * `admission_release`, otherwise (ADMIT_LIMIT_TOTAL) or (ADMIT_LIMIT_ADDR). */
+int admission_acquire(admission_t *adm, const connection_t *conn);
+
+/* Release a connection previously admitted by `admission_acquire`. */
+void admission_release(admission_t *adm, const connection_t *conn);
+
+/* Close a connection that was not admitted, using the given strategy. No data
+ * is read from the connection beforehand. */
+void admission_reject(const connection_t *conn, admit_reject_t how);
+
+#endif  // ADMISSION_H
@@ -6,32 +6,146 @@
 
 typedef struct key_val_t key_val_t;
 
+/* Value of a key after its first, kept when the key is inserted again. */
+typedef struct ht_value_t ht_value_t;
+
+/* Immutable copy of a hash table, made by `hash_table_freeze`. */
+typedef struct hash_table_frozen_t hash_table_frozen_t;
+
 typedef uint64_t (*ht_hash_fn)(const char *key, size_t key_len);
 
+/* Bump allocator backing an arena-backed hash table. `buf` is owned by the
+ * caller, and `used` bytes of it are allocated. */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t used;
+} ht_arena_t;
+
+/* How a hash table resolves collisions. */
+typedef enum {
+    HT_PROBE_QUADRATIC, /* Open addressing directly over the entries. */
+    HT_PROBE_SWISS,     /* Open addressing over an array of one control byte
+                           per entry, holding 7 bits of the hash, probed 16 at
+                           a time. Entries are only read on a likely match,
+                           which suits large tables. Capacity is at least 16. */
+    HT_PROBE_ROBIN_HOOD, /* Linear probing keeping entries ordered by their
+                            distance from their home slot, which bounds the
+                            variance of probe lengths. Deletion shifts later
+                            entries back instead of leaving tombstones, so
+                            lookup cost stays stable under churn. */
+} ht_probe_t;
+
+/* Options for `hash_table_init_opts`, with zero-initialized fields selecting
+ * the defaults. */
+typedef struct {
+    ht_hash_fn hash_fn; /* NULL for the default hash function. */
+    ht_arena_t *arena;  /* Allocate from the given arena instead of the heap. */
+    ht_probe_t probe;
+    int incremental;    /* Move entries into resized storage a few at a time
+                           over subsequent operations, instead of all at once,
+                           bounding the latency of any single operation. */
+} ht_opts_t;
+
+/* Tables start out as a small vector of entries, scanned linearly, and only
+ * switch to hashed storage of `capacity` slots, or more, once it is full. Few
+ * keys are then stored in less memory, and found with fewer cache misses. */
 typedef struct {
     key_val_t *entries;
+    uint8_t *ctrl;           /* Control bytes for (HT_PROBE_SWISS), following
+                                `entries` in the same allocation. */
     ht_hash_fn hash_fn;
+    ht_arena_t *arena;       /* Backs every allocation when non-NULL. */
+    size_t arena_mark;       /* `arena->used` once the table was created. */
+    key_val_t *init_entries; /* Entries allocated by `hash_table_init_arena`,
+                                restored by `hash_table_reset`. */
+    uint32_t init_capacity;
     uint32_t capacity;
     uint32_t size;
+    uint32_t tombstones;     /* Deleted slots counting towards the load. */
+    ht_probe_t probe;
+    int small;               /* Set while `entries` is the small vector, with
+                                `size` entries at its start. */
+    int incremental;
+    key_val_t *old_entries;  /* Storage being migrated away from by an
+                                incremental resize, otherwise NULL. */
+    uint32_t old_capacity;
+    uint32_t migrated;       /* Slots of `old_entries` moved so far. */
 } hash_table_t;
 
+/* Iterator over the values of a key, set up by `hash_table_values`. */
+typedef struct {
+    const char *next;       /* Returned by the next `hash_table_value_next`,
+                               NULL once every value was returned. */
+    const ht_value_t *rest; /* Values following `next`. */
+} ht_value_iter_t;
+
 /* Initialize a new hash table with the specified capacity and optional
  * custom hash function. Capacity must be a power-of-two. If `hash_fn` is NULL,
- * the default `FNV-1a` hashing function is used. Returns a pointer to the hash
- * table, otherwise NULL. */
+ * `hash_table_seeded_hash` is used. Returns a pointer to the hash table,
+ * otherwise NULL. */
 hash_table_t *hash_table_init(uint32_t capacity, ht_hash_fn hash_fn);
 
-/* Free the memory allocated for hash table and it's entries. */
+/* Initialize a new hash table as `hash_table_init`, with the table, its
+ * entries, keys and values all allocated from `arena` instead of the heap.
+ * Insertions fail once the arena is exhausted. The arena must outlive the
+ * table, and nothing is released back to it until `hash_table_reset`. Returns a
+ * pointer to the hash table, otherwise NULL. */
+hash_table_t *hash_table_init_arena(uint32_t capacity, ht_hash_fn hash_fn,
+                                    ht_arena_t *arena);
+
+/* Initialize a new hash table with the specified capacity and options, as
+ * `hash_table_init` or `hash_table_init_arena`. A NULL `opts` selects the
+ * defaults. Returns a pointer to the hash table, otherwise NULL. */
+hash_table_t *hash_table_init_opts(uint32_t capacity, const ht_opts_t *opts);
+
+/* Unseeded `FNV-1a` hash function, suitable for hashing binary keys that
+ * cannot be chosen by remote peers. */
+uint64_t hash_table_default_hash(const char *key, size_t key_len);
+
+/* Hash function used when none is provided to `hash_table_init`. Hashes 8
+ * bytes at a time, ignoring the case of ASCII letters, and is seeded with a
+ * random value picked at process start, so colliding keys cannot be computed
+ * ahead of time. */
+uint64_t hash_table_seeded_hash(const char *key, size_t key_len);
+
+/* Same as `hash_table_seeded_hash`, without folding case, for binary keys
+ * chosen by remote peers. */
+uint64_t hash_table_seeded_binary_hash(const char *key, size_t key_len);
+
+/* Free the memory allocated for hash table and it's entries. Arena-backed
+ * tables are left to the owner of the arena. */
 void hash_table_free(hash_table_t *ht);
 
-/* Insert a key/value pair into given hash table. Duplicate keys are updated
- * with the new value appended in a comma-separated list. Returns (1) on
- * successful insertion, otherwise (0). */
+/* Remove every key/value pair of the given hash table, keeping it usable. An
+ * arena-backed table is restored to its initial capacity, and its arena is
+ * rewound to where it was after `hash_table_init_arena`, without any call to
+ * the allocator. */
+void hash_table_reset(hash_table_t *ht);
+
+/* Insert a key/value pair into given hash table. Duplicate keys keep every
+ * value in insertion order, without copying those already stored. Returns (1)
+ * on successful insertion, otherwise (0). */
 int hash_table_insert(hash_table_t *ht, const char *key, const char *value);
 
-/* Return pointer to the value associated with the given key, otherwise NULL. */
+/* Return pointer to the value associated with the given key, otherwise NULL.
+ * Keys are matched ignoring the case of ASCII letters, directly against the
+ * bytes of `key` unless a custom hash function needs a lowercase copy. A key
+ * inserted more than once has its values joined in a comma-separated list,
+ * built on the first lookup after an insertion. */
 char *hash_table_lookup(hash_table_t *ht, const char *key);
 
+/* Set up `iter` to return each value of the given key in insertion order, as
+ * they were inserted rather than joined. The iterator is invalidated by
+ * deleting the key, or freeing or resetting the table. Returns the number of
+ * values of the key, (0) if it is not present. */
+size_t hash_table_values(hash_table_t *ht, const char *key,
+                         ht_value_iter_t *iter);
+
+/* Returns the next value of `iter`, otherwise NULL once every value was
+ * returned. */
+const char *hash_table_value_next(ht_value_iter_t *iter);
+
 /* Remove the key/value pair associated with the given key. Returns (1) on
  * successful deletion, otherwise (0). */
 int hash_table_delete(hash_table_t *ht, const char *key);
@@ -39,4 +153,19 @@ int hash_table_delete(hash_table_t *ht, const char *key);
 /* Prints the contents of the hash table to stdout. */
 void hash_table_debug_print(const hash_table_t *ht);
 
+/* Make an immutable copy of the given hash table in a single allocation, with
+ * its keys and values packed after the slots. Lookups on the copy only read
+ * it, so any number of threads may share it without synchronization, and it
+ * does not depend on `ht` afterwards. Returns a pointer to the frozen table,
+ * otherwise NULL. */
+hash_table_frozen_t *hash_table_freeze(const hash_table_t *ht);
+
+/* Return pointer to the value associated with the given key in the frozen
+ * table, otherwise NULL. */
+const char *hash_table_frozen_lookup(const hash_table_frozen_t *ft,
+                                     const char *key);
+
+/* Free the memory allocated for the frozen table. */
+void hash_table_frozen_free(hash_table_frozen_t *ft);
+
 #endif  // HASH_TABLE_H
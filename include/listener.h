@@ -7,16 +7,69 @@
 #endif
 
 #include <arpa/inet.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sys/socket.h>
 
+/* Returned by accept once the listening sockets were handed off to a successor
+ * process. */
+#define LISTENER_CLOSED -2
+
+/* Passed to `inherit` to take sockets from the `LISTEN_FDS`/`LISTEN_PID`
+ * environment variables set by a supervisor. */
+#define LISTENER_FDS_FROM_ENV -1
+
+/* Upper bound on listening sockets created for CPU-affine mode. */
+#define LISTENER_MAX_SHARDS 64
+
 typedef struct {
     char remote_addr[INET6_ADDRSTRLEN];
+    uint8_t remote_bin[16]; /* Binary remote address in network byte order,
+                               IPv4 addresses only use the first 4 bytes. */
+    sa_family_t remote_family;
     int clientfd;
 } connection_t;
 
+/* Optional socket tuning applied to the listening socket. Zeroed fields leave
+ * the corresponding option disabled. */
+typedef struct {
+    int defer_accept;  /* Seconds the kernel may hold a connection with no data
+                          before waking accept() (TCP_DEFER_ACCEPT). */
+    int fastopen_qlen; /* Maximum pending TCP Fast Open requests
+                          (TCP_FASTOPEN). */
+    int shards;        /* Number of SO_REUSEPORT sockets, one per CPU,
+                          steered by the CPU receiving the connection. */
+    const int *shard_cpus; /* CPU served by each shard, NULL for CPUs 0 to
+                              `shards` - 1. Connections received on any other
+                              CPU are spread across the shards. */
+} listener_opts_t;
+
+/* Counters describing how often the listener options took effect. */
+typedef struct {
+    uint64_t accepted; /* Total connections accepted. */
+    uint64_t deferred; /* Accepted with request bytes already queued. */
+    uint64_t fastopen; /* Accepted with data carried in the SYN. */
+    uint64_t cpu_local; /* Accepted on the shard serving the CPU that
+                           received it. */
+} listener_stats_t;
+
 typedef struct {
-    void (*listen)(const char *host, const char *port, int backlog);
+    void (*listen)(const char *host, const char *port, int backlog,
+                   const listener_opts_t *opts);
     int (*accept)(connection_t *conn);
+    int (*accept_shard)(size_t shard, connection_t *conn);
+    void (*stats)(listener_stats_t *stats);
+    /* Hot restart: `handoff` blocks until a successor takes over the sockets
+     * over the Unix socket at `path`, while `takeover` is called by the
+     * successor in place of `listen` and fails if there is no predecessor.
+     * The directory of `path` is created if missing, and must only be
+     * accessible by the current user. Both sides only accept a peer running
+     * as the same user, and sockets received must be listening. */
+    int (*handoff)(const char *path);
+    int (*takeover)(const char *path, const listener_opts_t *opts);
+    /* Socket activation: adopts already listening sockets from a supervisor in
+     * place of `listen`. Fails instead of exiting if none are usable. */
+    int (*inherit)(int fd, const listener_opts_t *opts);
     void (*close)(void);
 } listener_t;
 
@@ -21,6 +21,19 @@
 #define PARSE_INVALID -3 /* The parsed data is invalid or malformed. */
 #endif
 
+#ifndef PARSE_CONTINUE
+#define PARSE_CONTINUE -4 /* Head is complete, and the client waits for a
+                             `100 Continue` before sending the body. */
+#endif
+
+#ifndef PARSE_TOO_LARGE
+#define PARSE_TOO_LARGE -5 /* The body exceeds the accepted size. */
+#endif
+
+#ifndef PARSE_EXPECTATION_FAILED
+#define PARSE_EXPECTATION_FAILED -6 /* The `Expect` header is unsupported. */
+#endif
+
 #define METHOD_SIZE 7 /* Enough for the largest HTTP method supported here. */
 #define REQUEST_TARGET_SIZE 1025
 #define VERSION_SIZE 9 /* Only supporting HTTP/1.1 version. */
@@ -29,6 +42,15 @@
 #define HEADER_FIELD_VALUE_SIZE 512
 #define HEADERS_MAX_LIMIT 32
 
+/* Storage for the values of known headers, embedded in `request_t`. */
+#define HEADER_VALUES_SIZE 2048
+
+/* Query parameters indexed per request, any beyond are ignored. */
+#define QUERY_PARAMS_MAX 16
+
+/* Default limit on the size of the request line and headers combined. */
+#define HEAD_LIMIT (8 * 1024)
+
 #define BODY_SIZE 2048
 
 typedef enum {
@@ -38,28 +60,123 @@ typedef enum {
     PUT,
     DELETE,
     OPTIONS,
+    PATCH,
+    CONNECT,
+    TRACE,
     UNKNOWN_METHOD,
 } method_t;
 
 /* Lookup table to convert `method_t` -> `char *`. */
 extern const char *method_to_str[];
 
+/* Headers recognised while parsing and stored in `request_t.known_headers`
+ * instead of `request_t.headers`. */
+typedef enum {
+    HEADER_HOST,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_EXPECT,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_USER_AGENT,
+    KNOWN_HEADERS, /* Number of known headers. */
+} known_header_t;
+
+/* Lookup table to convert `known_header_t` -> lowercase field-name. */
+extern const char *known_header_to_str[];
+
 typedef struct {
     method_t method;
     char request_target[REQUEST_TARGET_SIZE];
+    size_t path_len;  /* Length of the path at the start of `request_target`. */
+    size_t query_len; /* Length of the query after the '?' following the path,
+                         (0) if there is none. */
     char version[VERSION_SIZE];
 } request_line_t;
 
+/* Query parameter, as slices of `request_line.request_target`. Neither slice
+ * is null-terminated. */
+typedef struct {
+    const char *key;
+    size_t key_len;
+    char *value;
+    size_t value_len;
+    int decoded; /* Set once `value` has been percent-decoded in place. */
+} query_param_t;
+
+/* Receives the next `len` bytes of the request body as they are parsed, with
+ * `ctx` being the `body_ctx` of the request. Called synchronously from
+ * `request_parse`, so no more data is read while the callback runs. Returns
+ * (PARSE_OK) to continue, any other status aborts parsing and is returned from
+ * `request_parse`. */
+typedef int (*request_body_cb)(void *ctx, const char *data, size_t len);
+
 typedef struct {
     request_line_t request_line;
-    hash_table_t *headers;
+    hash_table_t *headers; /* Headers other than the known headers. */
+    const char *known_headers[KNOWN_HEADERS]; /* Values of known headers, NULL
+                                                 if not present. */
+    char header_values[HEADER_VALUES_SIZE];   /* Storage for `known_headers`. */
+    size_t header_values_len;
     char body[BODY_SIZE];
     size_t body_len;
+    request_body_cb body_cb; /* Streams the body instead of buffering it in
+                                `body` when non-NULL. */
+    void *body_ctx;          /* Passed through to `body_cb`. */
+    size_t body_limit; /* Largest body accepted when streaming, (0) for no
+                          limit. Buffered bodies are limited by `BODY_SIZE`. */
+    size_t head_limit; /* Largest request line and headers accepted, (0) for
+                          `HEAD_LIMIT`. */
+    query_param_t query_params[QUERY_PARAMS_MAX]; /* Built on first access by
+                                                     `request_query_param`. */
+    size_t query_params_len;
+    int query_indexed;
+    int path_normalized; /* (1) once `request_path_normalize` succeeded, (-1)
+                            if it rejected the path, otherwise (0). */
 } request_t;
 
 /* Parses HTTP request chunks incrementally into the given `req`. Returns
- * one of (PARSE_OK), (PARSE_ERR), (PARSE_INCOMPLETE), or (PARSE_INVALID),
- * indicating status of parsing. */
+ * one of (PARSE_OK), (PARSE_ERR), (PARSE_INCOMPLETE), (PARSE_INVALID),
+ * (PARSE_TOO_LARGE) or (PARSE_EXPECTATION_FAILED), indicating status of
+ * parsing. Requests with `Expect: 100-continue` return (PARSE_CONTINUE) once
+ * the head is accepted, after which parsing continues with the body. Once the
+ * body is reached, data is delivered directly from `chunk`, so memory used per
+ * request does not depend on the size of a streamed body. Bodies using the
+ * chunked transfer coding are decoded as they arrive, with `body_len` set to
+ * the decoded length. A chunk holding the complete request line and headers
+ * is parsed in place, so its contents are modified. */
 int request_parse(request_t *req, char *chunk, size_t chunk_len);
 
+/* Returns the value of the header `name`, ignoring case, from either the known
+ * headers or the header table of `req`, otherwise NULL. Not `const`, as a
+ * lookup in the header table may move entries or cache the joined value of a
+ * repeated header, so concurrent calls on the same `req` must be
+ * synchronized. */
+const char *request_header(request_t *req, const char *name);
+
+/* Returns the query parameter `key` of the request-target of `req`, otherwise
+ * NULL. The query is indexed on the first call, and each value is
+ * percent-decoded, in place within `request_target`, on its first access.
+ * Keys are matched without decoding. */
+const query_param_t *request_query_param(request_t *req, const char *key);
+
+/* Percent-decodes the path of `req`, then removes its dot-segments and
+ * repeated slashes, in place within `request_target`. The query, and any
+ * indexed query parameters, are moved to follow the new path. The path is
+ * only ever decoded once, so later calls return the result of the first
+ * without decoding it again. Returns (PARSE_OK) on success, otherwise
+ * (PARSE_INVALID) if the decoded path holds a null byte. */
+int request_path_normalize(request_t *req);
+
+/* Discards any partially parsed request held by the calling thread, keeping its
+ * cached buffers. Must be called when a connection ends, so a request aborted
+ * midway does not carry over into the next connection parsed on the thread. */
+void request_parse_reset(void);
+
+/* Frees the buffers cached by the calling thread for parsing requests. Must be
+ * called before a thread that used `request_parse` exits. */
+void request_parse_cleanup(void);
+
 #endif  // REQUEST_H
@@ -0,0 +1,26 @@
+#ifndef URI_H
+#define URI_H
+
+#include <stddef.h>
+
+/* Returns the value of hex digit `c`, otherwise (-1). */
+static inline int uri_hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+/* Percent-decode the `len` bytes of `str` in place, also decoding '+' as a
+ * space when `plus_as_space` is non-zero, as in form-encoded query strings.
+ * Malformed escapes are kept as they are. Input without any escapes is not
+ * rewritten. Returns the decoded length. */
+size_t uri_percent_decode(char *str, size_t len, int plus_as_space);
+
+/* Remove the "." and ".." segments of the absolute `path` of `len` bytes in
+ * place, as RFC 3986 describes, also merging repeated slashes. Paths not
+ * starting with '/' are left as they are. Returns the normalized length. */
+size_t uri_path_normalize(char *path, size_t len);
+
+#endif  // URI_H
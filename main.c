@@ -1,163 +1,445 @@
+/* Exposes pthread_setaffinity_np() and the cpu_set_t macros. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <inttypes.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "admission.h"
 #include "channel.h"
 #include "listener.h"
 #include "request.h"
 
-// ENCODE_INT(n): int -> intptr_t -> void *
-#define ENCODE_INT(n) ((void *)(intptr_t)(n))
-// DECODE_INT(p): void * -> intptr_t -> int
-#define DECODE_INT(p) ((int)(intptr_t)(p))
-
 #define HOST "127.0.0.1"
 #define PORT "8080"
 #define BACKLOG 16 /* Maximum number of pending connections in the queue. */
 
+// Seconds a connection may sit without data before accept() sees it.
+#define DEFER_ACCEPT 1
+// Maximum number of pending TCP Fast Open requests.
+#define FASTOPEN_QLEN 16
+
+// When non-zero, one worker per CPU the process may run on is pinned to that
+// CPU, and accepts from its own SO_REUSEPORT socket instead of reading
+// connections from the channel.
+#ifndef CPU_AFFINE
+#define CPU_AFFINE 0
+#endif
+
+// Live connections allowed in total and from a single remote address, with
+// IPv6 clients limited per /64. Excess connections are rejected before any of
+// the request is read.
+#define MAX_CONNECTIONS 1024
+#define MAX_CONNECTIONS_PER_ADDR 64
+#define ADMISSION_REJECT ADMIT_REJECT_503
+
+// Unix socket used to pass the listening sockets to a restarted process,
+// placed in `$XDG_RUNTIME_DIR`, otherwise in a directory of its own under
+// /tmp, so only the user running the server can reach it. Overridden by the
+// `HTTPC_HANDOFF_PATH` environment variable.
+#define HANDOFF_NAME "httpc.sock"
+
 // Timeout in milliseconds.
 #define POLLING_TIMEOUT 5
+// Timeout in milliseconds for the body after sending `100 Continue`, as the
+// client only starts sending once it has seen the response.
+#define CONTINUE_TIMEOUT 1000
+
+// Large enough for a typical request head to be read, and parsed, at once.
+#define BUFFER_SIZE 4096
 
-#define BUFFER_SIZE 8
+// Memory for the headers of a single request, so they are stored without any
+// call to the allocator.
+#define HEADER_ARENA_SIZE (32 * 1024)
+
+// Largest request body accepted. Bodies are streamed, so this does not affect
+// memory used per connection.
+#define MAX_BODY_SIZE (16 * 1024 * 1024)
 
 #define THREAD_POOL 8
 #define CHANNEL_SIZE 16
 channel_t *chan;
+admission_t *admission;
+
+listener_t *listener = &tcp_listener;
+
+static char handoff_path[108]; /* Size of `sockaddr_un.sun_path`. */
+
+// CPU each worker is pinned to in CPU-affine mode, shared with the listener so
+// connections are steered to the worker pinned to the CPU receiving them.
+static int shard_cpus[LISTENER_MAX_SHARDS];
+
+static const char response_100[] = "HTTP/1.1 100 Continue\r\n\r\n";
+static const char response_413[] =
+    "HTTP/1.1 413 Content Too Large\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+static const char response_417[] =
+    "HTTP/1.1 417 Expectation Failed\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+// Write a canned `response` of `len` bytes to `clientfd`, ignoring errors
+// since the connection is closed afterwards in that case anyway.
+static void send_response(int clientfd, const char *response, size_t len) {
+    if (send(clientfd, response, len, MSG_NOSIGNAL) == -1) {
+        perror("ERROR: send");
+    }
+}
+
+// Counts the bytes of a streamed request body into `ctx`.
+static int count_body(void *ctx, const char *data, size_t len) {
+    (void)data;
+
+    *(size_t *)ctx += len;
+    return PARSE_OK;
+}
 
 // TODO: replace polling since it is only on one socket at a time
-// consumer: reads client connections from channel and writes lines to stdout.
-static void *consumer(void *arg) {
-    (void)arg;
+// Reads and parses a single request from `clientfd`, writing it to stdout
+// before closing the connection. Returns (-1) if the connection was closed
+// without being read, otherwise (0).
+static int handle_connection(int clientfd) {
+    size_t body_bytes = 0;
+
+    char arena_buf[HEADER_ARENA_SIZE];
+    ht_arena_t arena = {.buf = arena_buf, .size = sizeof arena_buf};
+
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init_arena(64, NULL, &arena),
+        .body_cb = count_body,
+        .body_ctx = &body_bytes,
+        .body_limit = MAX_BODY_SIZE,
+    };
+
+    if (!req.headers) {
+        close(clientfd);
+        return -1;
+    }
 
+    char buf[BUFFER_SIZE + 1];
+
+    struct pollfd pfd[1];
+
+    pfd[0].fd = clientfd;
+    pfd[0].events = POLLIN;
+
+    int status, events;
+    int timeout = POLLING_TIMEOUT;
+    ssize_t bytes_read = 0;
     while (1) {
-        int clientfd = DECODE_INT(channel_read(chan));
+        // Poll client socket for reading to avoid blocking on recv().
+        events = poll(pfd, 1, timeout);
+        if (events == -1) {
+            break;
+        }
 
-        request_t req = {
-            .request_line = {0},
-            .headers = hash_table_init(64, NULL),
-        };
+        // Timeout expired.
+        if (events == 0) {
+            while ((status = request_parse(&req, "", 0)) == PARSE_INCOMPLETE);
+        } else if (pfd[0].revents & POLLIN) {
+            // Check if POLLIN is set and data is ready to read.
+            bytes_read = recv(clientfd, buf, (sizeof buf) - 1, 0);
+            if (bytes_read <= 0) {
+                break;
+            }
 
-        if (!req.headers) {
-            close(clientfd);
-            pthread_exit(NULL);
+            buf[bytes_read] = '\0';
+            status = request_parse(&req, buf, (size_t)bytes_read);
+        } else {
+            continue;
         }
 
-        char buf[BUFFER_SIZE + 1];
+        // Head was accepted, so let the client send the body.
+        if (status == PARSE_CONTINUE) {
+            send_response(clientfd, response_100, sizeof response_100 - 1);
+            timeout = CONTINUE_TIMEOUT;
+            continue;
+        }
 
-        struct pollfd pfd[1];
+        if (status != PARSE_INCOMPLETE) {
+            break;
+        }
+    }
 
-        pfd[0].fd = clientfd;
-        pfd[0].events = POLLIN;
+    if (events == -1) {
+        perror("ERROR: poll");
 
-        int status, events;
-        ssize_t bytes_read;
-        while (1) {
-            // Poll client socket for reading to avoid blocking on recv().
-            events = poll(pfd, 1, POLLING_TIMEOUT);
-            if (events == -1) {
-                break;
-            }
+        printf("server: client connection closed\n");
+        request_parse_reset();
+        hash_table_free(req.headers);
+        close(clientfd);
+        return 0;
+    }
 
-            // Timeout expired.
-            if (events == 0) {
-                while ((status = request_parse(&req, "", 0)) ==
-                       PARSE_INCOMPLETE);
-                break;
-            }
+    if (bytes_read == -1) {
+        perror("ERROR: recv");
 
-            // Check if POLLIN is set and data is ready to read.
-            if (pfd[0].revents & POLLIN) {
-                bytes_read = recv(clientfd, buf, (sizeof buf) - 1, 0);
-                if (bytes_read <= 0) {
-                    break;
-                }
+        printf("server: client connection closed\n");
+        request_parse_reset();
+        hash_table_free(req.headers);
+        close(clientfd);
+        return 0;
+    }
 
-                buf[bytes_read] = '\0';
-                if ((status = request_parse(&req, buf, (size_t)bytes_read)) !=
-                    PARSE_INCOMPLETE) {
-                    break;
+    switch (status) {
+        case PARSE_OK:
+            printf("Request Line: \n");
+            printf("- Method: %s\n", method_to_str[req.request_line.method]);
+            printf("- Target: %s\n", req.request_line.request_target);
+            printf("- Version: %s\n", req.request_line.version);
+            printf("Headers: \n");
+            for (size_t i = 0; i < KNOWN_HEADERS; ++i) {
+                if (req.known_headers[i]) {
+                    printf("- \"%s\": \"%s\"\n", known_header_to_str[i],
+                           req.known_headers[i]);
                 }
             }
+            hash_table_debug_print(req.headers);
+            printf("Body: \n");
+            printf("- %zu bytes\n", body_bytes);
+            break;
+        case PARSE_ERR:
+            printf("server: server error occured\n");
+            break;
+        case PARSE_TOO_LARGE:
+            send_response(clientfd, response_413, sizeof response_413 - 1);
+            printf("server: request body too large\n");
+            break;
+        case PARSE_EXPECTATION_FAILED:
+            send_response(clientfd, response_417, sizeof response_417 - 1);
+            printf("server: unsupported expectation\n");
+            break;
+        case PARSE_INCOMPLETE:
+        case PARSE_INVALID:
+            printf("server: error occured parsing HTTP request\n");
+            break;
+    }
+
+    printf("server: client connection closed\n");
+    // The connection may end mid-request, so drop any partial parser state
+    // before the next connection on this thread.
+    request_parse_reset();
+    hash_table_free(req.headers);
+    close(clientfd);
+    return 0;
+}
+
+// Apply admission control to an accepted connection. Returns (1) if it should
+// be served, otherwise (0) once it has been rejected and closed.
+static int admit_connection(const connection_t *conn) {
+    int status = admission_acquire(admission, conn);
+    if (status == ADMIT_OK) {
+        return 1;
+    }
+
+    printf("server: rejected connection from %s (%s limit)\n",
+           conn->remote_addr, status == ADMIT_LIMIT_ADDR ? "address" : "total");
+    admission_reject(conn, ADMISSION_REJECT);
+    return 0;
+}
+
+// consumer: reads client connections from channel and writes lines to stdout.
+static void *consumer(void *arg) {
+    (void)arg;
+
+    while (1) {
+        connection_t *conn = channel_read(chan);
+
+        // Listener was handed off and queued connections are drained.
+        if (!conn) {
+            break;
         }
 
-        if (events == -1) {
-            perror("ERROR: poll");
+        if (handle_connection(conn->clientfd) == -1) {
+            fprintf(stderr, "ERROR: handle_connection: no memory for %s.\n",
+                    conn->remote_addr);
+        }
+        admission_release(admission, conn);
+        free(conn);
+    }
 
-            printf("server: client connection closed\n");
-            hash_table_free(req.headers);
-            close(clientfd);
+    request_parse_cleanup();
+    return NULL;
+}
+
+// affine_worker: pins itself to the CPU served by its shard, then accepts and
+// handles connections from that shard's listening socket.
+static void *affine_worker(void *arg) {
+    size_t shard = (size_t)(uintptr_t)arg;
+    int cpu = shard_cpus[shard];
+    connection_t conn;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET((size_t)cpu, &cpus);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof cpus, &cpus) != 0) {
+        fprintf(stderr, "ERROR: pthread_setaffinity_np: failed to pin %d.\n",
+                cpu);
+    }
+
+    while (1) {
+        int status = listener->accept_shard(shard, &conn);
+        if (status == LISTENER_CLOSED) {
+            break;
+        }
+
+        if (status == -1) {
             continue;
         }
 
-        if (bytes_read == -1) {
-            perror("ERROR: recv");
+        printf("server: [cpu %d] got connection from %s\n", cpu,
+               conn.remote_addr);
 
-            printf("server: client connection closed\n");
-            hash_table_free(req.headers);
-            close(clientfd);
+        if (!admit_connection(&conn)) {
             continue;
         }
 
-        switch (status) {
-            case PARSE_OK:
-                printf("Request Line: \n");
-                printf("- Method: %s\n",
-                       method_to_str[req.request_line.method]);
-                printf("- Target: %s\n", req.request_line.request_target);
-                printf("- Version: %s\n", req.request_line.version);
-                printf("Headers: \n");
-                hash_table_debug_print(req.headers);
-                printf("Body: \n");
-                printf("- %s\n", req.body);
-
-                printf("server: client connection closed\n");
-                hash_table_free(req.headers);
-                close(clientfd);
-                continue;
-            case PARSE_ERR:
-                printf("server: server error occured\n");
-
-                printf("server: client connection closed\n");
-                hash_table_free(req.headers);
-                close(clientfd);
-                continue;
-            case PARSE_INCOMPLETE:
-            case PARSE_INVALID:
-                printf("server: error occured parsing HTTP request\n");
-
-                printf("server: client connection closed\n");
-                hash_table_free(req.headers);
-                close(clientfd);
-                continue;
+#ifdef _DEBUG
+        listener_stats_t stats;
+        listener->stats(&stats);
+        printf("server: accepted = %" PRIu64 "\tcpu_local = %" PRIu64 "\n",
+               stats.accepted, stats.cpu_local);
+#endif
+
+        if (handle_connection(conn.clientfd) == -1) {
+            fprintf(stderr, "ERROR: handle_connection: no memory for %s.\n",
+                    conn.remote_addr);
         }
+        admission_release(admission, &conn);
     }
 
+    request_parse_cleanup();
     return NULL;
 }
 
+// handoff_worker: waits for a restarted process to take over the listening
+// sockets, after which this process stops accepting and drains.
+static void *handoff_worker(void *arg) {
+    (void)arg;
+
+    if (listener->handoff(handoff_path) == 0) {
+        printf("server: listening sockets handed off, draining...\n");
+    }
+
+    return NULL;
+}
+
+// Fill `shard_cpus` with the CPUs in the affinity mask of the process, which
+// may not start at CPU 0 under cpusets. Returns the number of CPUs, at most
+// (LISTENER_MAX_SHARDS), otherwise (0).
+static size_t shard_cpus_init(void) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == -1) {
+        perror("ERROR: sched_getaffinity");
+        return 0;
+    }
+
+    size_t count = 0;
+    for (size_t cpu = 0; cpu < CPU_SETSIZE && count < LISTENER_MAX_SHARDS;
+         ++cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            shard_cpus[count++] = (int)cpu;
+        }
+    }
+
+    return count;
+}
+
+// Choose the path of the hot restart socket into `handoff_path`.
+static void handoff_path_init(void) {
+    const char *path = getenv("HTTPC_HANDOFF_PATH");
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    int len;
+
+    if (path) {
+        len = snprintf(handoff_path, sizeof handoff_path, "%s", path);
+    } else if (runtime_dir && runtime_dir[0] == '/') {
+        len = snprintf(handoff_path, sizeof handoff_path, "%s/httpc/%s",
+                       runtime_dir, HANDOFF_NAME);
+    } else {
+        len = snprintf(handoff_path, sizeof handoff_path, "/tmp/httpc-%u/%s",
+                       (unsigned)geteuid(), HANDOFF_NAME);
+    }
+
+    // The listener rejects the empty path, disabling hot restart.
+    if (len < 0 || (size_t)len >= sizeof handoff_path) {
+        fprintf(stderr, "ERROR: server: handoff path too long.\n");
+        handoff_path[0] = '\0';
+    }
+}
+
 // producer: accepts incoming connections and writes connections to channel.
 int main(void) {
     // Disable buffering for stdout (line-buffered by default).
     setbuf(stdout, NULL);
 
-    listener_t *listener = &tcp_listener;
+    handoff_path_init();
+
+    listener_opts_t listener_opts = {
+        .defer_accept = DEFER_ACCEPT,
+        .fastopen_qlen = FASTOPEN_QLEN,
+    };
     connection_t conn;
 
+    // One shard, and worker, per CPU the process may run on.
+    size_t workers = THREAD_POOL;
+    if (CPU_AFFINE) {
+        workers = shard_cpus_init();
+        if (workers == 0) {
+            exit(1);
+        }
+
+        listener_opts.shards = (int)workers;
+        listener_opts.shard_cpus = shard_cpus;
+    }
+
     chan = channel_init(CHANNEL_SIZE);
     if (!chan) {
         exit(1);
     }
 
-    listener->listen(HOST, PORT, BACKLOG);
+    admission = admission_init(MAX_CONNECTIONS, MAX_CONNECTIONS_PER_ADDR);
+    if (!admission) {
+        channel_free(chan, NULL);
+        exit(1);
+    }
+
+    // Inherit the sockets of a running predecessor so no connection is
+    // refused during a restart, then those passed by a supervisor, otherwise
+    // bind new ones.
+    if (listener->takeover(handoff_path, &listener_opts) == 0) {
+        printf("server: took over listening sockets from predecessor\n");
+    } else if (listener->inherit(LISTENER_FDS_FROM_ENV, &listener_opts) == 0) {
+        printf("server: using listening sockets from supervisor\n");
+    } else {
+        listener->listen(HOST, PORT, BACKLOG, &listener_opts);
+    }
 
     printf("server: [%s:%s] waiting for connections...\n", HOST, PORT);
 
-    pthread_t cons_threads[THREAD_POOL];
+    pthread_t handoff_thread;
+    if (pthread_create(&handoff_thread, NULL, handoff_worker, NULL) != 0 ||
+        pthread_detach(handoff_thread) != 0) {
+        perror("ERROR: pthread_create");
+    }
+
+    pthread_t cons_threads[CPU_AFFINE ? LISTENER_MAX_SHARDS : THREAD_POOL];
 
-    for (size_t i = 0; i < THREAD_POOL; ++i) {
-        if (pthread_create(&cons_threads[i], NULL, consumer, NULL) != 0) {
+    for (size_t i = 0; i < workers; ++i) {
+        void *(*worker)(void *) = CPU_AFFINE ? affine_worker : consumer;
+        if (pthread_create(&cons_threads[i], NULL, worker,
+                           (void *)(uintptr_t)i) != 0) {
             perror("ERROR: pthread_create");
             channel_free(chan, NULL);
             listener->close();
@@ -165,17 +447,48 @@ int main(void) {
         }
     }
 
-    while (1) {
-        if (listener->accept(&conn) == -1) {
+    while (!CPU_AFFINE) {
+        int status = listener->accept(&conn);
+        if (status == LISTENER_CLOSED) {
+            // Wake each consumer once queued connections are handled.
+            for (size_t i = 0; i < workers; ++i) {
+                channel_write(chan, NULL);
+            }
+            break;
+        }
+
+        if (status == -1) {
             continue;
         }
 
         printf("server: got connection from %s\n", conn.remote_addr);
 
-        channel_write(chan, ENCODE_INT(conn.clientfd));
+#ifdef _DEBUG
+        listener_stats_t stats;
+        listener->stats(&stats);
+        printf("server: accepted = %" PRIu64 "\tdeferred = %" PRIu64
+               "\tfastopen = %" PRIu64 "\n",
+               stats.accepted, stats.deferred, stats.fastopen);
+#endif
+
+        if (!admit_connection(&conn)) {
+            continue;
+        }
+
+        // Consumers need the remote address to release the connection.
+        connection_t *queued = malloc(sizeof(*queued));
+        if (!queued) {
+            perror("ERROR: malloc");
+            admission_release(admission, &conn);
+            close(conn.clientfd);
+            continue;
+        }
+
+        *queued = conn;
+        channel_write(chan, queued);
     }
 
-    for (size_t i = 0; i < THREAD_POOL; ++i) {
+    for (size_t i = 0; i < workers; ++i) {
         if (pthread_join(cons_threads[i], NULL) != 0) {
             fprintf(stderr, "ERROR: pthread_join: failed to join thread.\n");
             channel_free(chan, NULL);
@@ -185,6 +498,7 @@ int main(void) {
     }
 
     channel_free(chan, NULL);
+    admission_free(admission);
     listener->close();
     return 0;
 }
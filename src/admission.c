@@ -0,0 +1,309 @@
+#include "admission.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hash_table.h"
+
+// Leading bits of an IPv6 address a client is accounted under.
+#define IPV6_PREFIX_BYTES 8
+
+// Purge tombstones once live and deleted slots reach 70% capacity.
+#define LOAD_FACTOR 0.7
+
+// Upper bound on request bytes discarded before closing a rejected connection.
+#define REJECT_DRAIN_SIZE 4096
+
+static const char reject_503[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "Retry-After: 1\r\n"
+    "\r\n";
+
+typedef enum {
+    SLOT_EMPTY = 0,
+    SLOT_USED,
+    SLOT_DELETED, /* Acts as a tombstone marker. */
+    SLOT_PENDING, /* Holds an address not yet moved by `purge_tombstones`. */
+} slot_state_t;
+
+// Address a connection is accounted under, see `addr_key`.
+typedef struct {
+    uint8_t addr[16];
+    sa_family_t family;
+} addr_key_t;
+
+typedef struct {
+    uint8_t addr[16];   /* Binary remote address, as in `addr_key_t`. */
+    sa_family_t family; /* Address family, part of the key. */
+    uint8_t state;      /* One of `slot_state_t`. */
+    uint32_t count;     /* Live connections from this address. */
+} addr_slot_t;
+
+struct admission_t {
+    addr_slot_t *slots;
+    uint32_t mask;         /* Using bitmask for wrapping slot indices. */
+    uint32_t used;         /* Slots holding an address. */
+    uint32_t deleted;      /* Slots marked as tombstones. */
+    uint32_t total;        /* Live connections across all addresses. */
+    uint32_t max_total;    /* Global connection limit. */
+    uint32_t max_per_addr; /* Per-address connection limit. */
+
+    pthread_mutex_t lock; /* Synchronizes access to the table. */
+};
+
+// Addresses are chosen by clients, so a seeded hash keeps them from picking
+// addresses that collide.
+static inline uint64_t addr_hash(const uint8_t *addr, sa_family_t family) {
+    return hash_table_seeded_binary_hash((const char *)addr, 16) ^ family;
+}
+
+// Fill `key` with the address `conn` is accounted under. IPv6 clients are
+// keyed on their /64 prefix, the smallest block usually assigned to a single
+// subscriber, as any client holding one could otherwise use a new address per
+// connection to escape the per-address limit. IPv4-mapped IPv6 addresses are
+// keyed as the IPv4 address they carry.
+static void addr_key(const connection_t *conn, addr_key_t *key) {
+    static const uint8_t v4_mapped[12] = {0, 0, 0, 0, 0,    0,
+                                          0, 0, 0, 0, 0xff, 0xff};
+
+    memset(key, 0, sizeof *key);
+    key->family = conn->remote_family;
+
+    if (conn->remote_family != AF_INET6) {
+        memcpy(key->addr, conn->remote_bin, sizeof key->addr);
+    } else if (memcmp(conn->remote_bin, v4_mapped, sizeof v4_mapped) == 0) {
+        key->family = AF_INET;
+        memcpy(key->addr, conn->remote_bin + sizeof v4_mapped, 4);
+    } else {
+        memcpy(key->addr, conn->remote_bin, IPV6_PREFIX_BYTES);
+    }
+}
+
+// Return the index of the slot holding `key`. If absent, returns the first free
+// slot on its probe sequence and sets `found` to (0).
+static uint32_t find_slot(const admission_t *adm, const addr_key_t *key,
+                          int *found) {
+    uint32_t idx = (uint32_t)addr_hash(key->addr, key->family) & adm->mask;
+    uint32_t first_free = UINT32_MAX;
+
+    // Using `open addressing` with `quadratic probing` over triangular numbers,
+    // which visits every slot of a power-of-two table. The table never fills
+    // up, as the number of addresses is bounded by the connection limit, and
+    // tombstones are purged before they reach the load factor.
+    for (uint32_t i = 1;; ++i) {
+        addr_slot_t *slot = &adm->slots[idx];
+
+        if (slot->state == SLOT_EMPTY) {
+            *found = 0;
+            return first_free != UINT32_MAX ? first_free : idx;
+        }
+
+        if (slot->state == SLOT_DELETED) {
+            if (first_free == UINT32_MAX) {
+                first_free = idx;
+            }
+        } else if (slot->family == key->family &&
+                   memcmp(slot->addr, key->addr, sizeof slot->addr) == 0) {
+            *found = 1;
+            return idx;
+        }
+
+        idx = (idx + i) & adm->mask;
+    }
+}
+
+// Rebuild the table in place without tombstones, so probe sequences stay short
+// under connection churn. Needs no allocation, so it cannot fail.
+static void purge_tombstones(admission_t *adm) {
+    uint32_t capacity = adm->mask + 1;
+
+    // Every address is moved again, into the first slot of its probe sequence
+    // not holding an address already moved.
+    for (uint32_t i = 0; i < capacity; ++i) {
+        uint8_t state = adm->slots[i].state;
+        adm->slots[i].state = state == SLOT_USED ? SLOT_PENDING : SLOT_EMPTY;
+    }
+
+    for (uint32_t i = 0; i < capacity; ++i) {
+        while (adm->slots[i].state == SLOT_PENDING) {
+            addr_slot_t moving = adm->slots[i];
+
+            uint32_t idx = (uint32_t)addr_hash(moving.addr, moving.family) &
+                           adm->mask;
+            for (uint32_t step = 1; adm->slots[idx].state == SLOT_USED;
+                 ++step) {
+                idx = (idx + step) & adm->mask;
+            }
+
+            moving.state = SLOT_USED;
+
+            if (idx == i) {
+                adm->slots[i] = moving;
+            } else if (adm->slots[idx].state == SLOT_EMPTY) {
+                adm->slots[idx] = moving;
+                adm->slots[i].state = SLOT_EMPTY;
+            } else {
+                // Swap with the pending address, which is moved next.
+                adm->slots[i] = adm->slots[idx];
+                adm->slots[idx] = moving;
+            }
+        }
+    }
+
+    adm->deleted = 0;
+}
+
+admission_t *admission_init(uint32_t max_total, uint32_t max_per_addr) {
+    assert(max_total > 0 && max_per_addr > 0);
+
+    admission_t *adm = malloc(sizeof(*adm));
+    if (!adm) {
+        perror("ERROR: admission_init (malloc)");
+        return NULL;
+    }
+
+    // Smallest power-of-two capacity keeping every possible address below the
+    // load factor.
+    uint32_t capacity = 16;
+    while (capacity * LOAD_FACTOR <= max_total) {
+        capacity *= 2;
+    }
+
+    adm->slots = calloc(capacity, sizeof(*adm->slots));
+    if (!adm->slots) {
+        perror("ERROR: admission_init (calloc)");
+        free(adm);
+        return NULL;
+    }
+
+    adm->mask = capacity - 1;
+    adm->used = 0;
+    adm->deleted = 0;
+    adm->total = 0;
+    adm->max_total = max_total;
+    adm->max_per_addr = max_per_addr;
+
+    // Function always returns 0.
+    pthread_mutex_init(&adm->lock, NULL);
+
+    return adm;
+}
+
+void admission_free(admission_t *adm) {
+    assert(adm);
+
+    pthread_mutex_destroy(&adm->lock);
+
+    free(adm->slots);
+    free(adm);
+}
+
+int admission_acquire(admission_t *adm, const connection_t *conn) {
+    assert(adm && conn);
+
+    pthread_mutex_lock(&adm->lock);
+
+    if (adm->total >= adm->max_total) {
+        pthread_mutex_unlock(&adm->lock);
+        return ADMIT_LIMIT_TOTAL;
+    }
+
+    addr_key_t key;
+    addr_key(conn, &key);
+
+    int found;
+    addr_slot_t *slot = &adm->slots[find_slot(adm, &key, &found)];
+
+    if (found) {
+        if (slot->count >= adm->max_per_addr) {
+            pthread_mutex_unlock(&adm->lock);
+            return ADMIT_LIMIT_ADDR;
+        }
+
+        slot->count++;
+    } else {
+        // Same preference for initially empty slots or tombstones.
+        if (slot->state == SLOT_DELETED) {
+            adm->deleted--;
+        }
+
+        memcpy(slot->addr, key.addr, sizeof slot->addr);
+        slot->family = key.family;
+        slot->state = SLOT_USED;
+        slot->count = 1;
+        adm->used++;
+    }
+
+    adm->total++;
+
+    if (adm->used + adm->deleted >= LOAD_FACTOR * (adm->mask + 1)) {
+        purge_tombstones(adm);
+    }
+
+    pthread_mutex_unlock(&adm->lock);
+    return ADMIT_OK;
+}
+
+void admission_release(admission_t *adm, const connection_t *conn) {
+    assert(adm && conn);
+
+    pthread_mutex_lock(&adm->lock);
+
+    addr_key_t key;
+    addr_key(conn, &key);
+
+    int found;
+    addr_slot_t *slot = &adm->slots[find_slot(adm, &key, &found)];
+
+    if (found) {
+        adm->total--;
+
+        if (--slot->count == 0) {
+            slot->state = SLOT_DELETED;
+            adm->used--;
+            adm->deleted++;
+        }
+    }
+
+    pthread_mutex_unlock(&adm->lock);
+}
+
+void admission_reject(const connection_t *conn, admit_reject_t how) {
+    assert(conn);
+
+    switch (how) {
+        case ADMIT_REJECT_RST: {
+            // Zero linger timeout makes close() abort the connection with a
+            // reset instead of the regular shutdown sequence.
+            struct linger linger = {.l_onoff = 1, .l_linger = 0};
+            if (setsockopt(conn->clientfd, SOL_SOCKET, SO_LINGER, &linger,
+                           sizeof linger) == -1) {
+                perror("ERROR: setsockopt (SO_LINGER)");
+            }
+            break;
+        }
+        case ADMIT_REJECT_503: {
+            // Never block the accepting thread on a slow client.
+            if (send(conn->clientfd, reject_503, sizeof reject_503 - 1,
+                     MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+                break;
+            }
+
+            shutdown(conn->clientfd, SHUT_WR);
+
+            // Closing with unread data pending would send a reset that may
+            // discard the response, so discard what already arrived.
+            char discard[REJECT_DRAIN_SIZE];
+            recv(conn->clientfd, discard, sizeof discard, MSG_DONTWAIT);
+            break;
+        }
+    }
+
+    close(conn->clientfd);
+}
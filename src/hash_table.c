@@ -1,22 +1,89 @@
 #include "hash_table.h"
 
 #include <assert.h>
-#include <ctype.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Resize at 70% capacity to prevent excessive collisions.
 #define LOAD_FACTOR 0.7
 
+// Alignment of every allocation made from an arena.
+#define ARENA_ALIGN 16
+
+// Entries held by the small vector a table starts out as. Scanning this many
+// cached hashes linearly is cheaper than probing hashed storage.
+#define SMALL_SIZE 16
+
+// Slots moved per operation while an incremental resize is in progress.
+#define MIGRATE_STEP 16
+
+// Longest key lowercased on the stack for a custom hash function, longer keys
+// are copied to the heap instead.
+#define FOLD_STACK_SIZE 256
+
+// Number of control bytes probed at once by (HT_PROBE_SWISS).
+#define GROUP_WIDTH 16
+
+// Control bytes of (HT_PROBE_SWISS). Slots holding an entry have the high bit
+// set, with the low 7 bits of the entry's hash in the remaining bits, so that
+// zeroed memory is a table of empty slots.
+#define CTRL_EMPTY 0x00
+#define CTRL_DELETED 0x01
+#define CTRL_FULL 0x80
+
+// Values of a key inserted more than once, after the first held by its entry,
+// in insertion order.
+struct ht_value_t {
+    struct ht_value_t *next;
+    size_t len;
+    char value[];
+};
+
+typedef struct {
+    ht_value_t *head;
+    ht_value_t *tail;
+    char *joined;      /* Every value joined in a comma-separated list, built
+                          on lookup and dropped by the next insertion. */
+    size_t joined_len; /* Length of `joined`, even when not built. */
+    size_t count;      /* Number of values, including the first. */
+} ht_values_t;
+
 struct key_val_t {
     char *key;
-    char *value;
-    uint8_t is_deleted; /* Acts as a tombstone marker. Set to (1) when deleted,
-                           (0) by default. */
+    char *value;         /* First value of `key`. */
+    ht_values_t *values; /* Any later values, otherwise NULL. */
+    uint64_t hash;       /* Hash of `key`, so probes and resizes need not
+                            rehash or compare the key itself. */
+    uint32_t key_len;
+    uint8_t is_deleted;  /* Acts as a tombstone marker. Set to (1) when
+                            deleted, (0) by default. */
+};
+
+// Slot of a frozen table. Strings are located by their offset from the start
+// of the table, so an offset of (0) marks an empty slot.
+typedef struct {
+    uint64_t hash;
+    uint32_t key_off;
+    uint32_t key_len;
+    uint32_t value_off;
+} frozen_slot_t;
+
+struct hash_table_frozen_t {
+    ht_hash_fn hash_fn;
+    uint32_t capacity;
+    uint32_t size;
+    frozen_slot_t slots[]; /* Followed by the null-terminated keys and
+                              values. */
 };
 
 // FNV-1a [https://en.wikipedia.org/wiki/Fowler–Noll–Vo_hash_function].
-static inline uint64_t fnv_1a_hash(const char *key, size_t key_len) {
+uint64_t hash_table_default_hash(const char *key, size_t key_len) {
     uint64_t hash = 0xcbf29ce484222325; /* FNV offset-bias (64-bit) */
 
     for (size_t i = 0; i < key_len; ++i) {
@@ -27,201 +94,404 @@ static inline uint64_t fnv_1a_hash(const char *key, size_t key_len) {
     return hash;
 }
 
-static void key_to_lower(char *dest, const char *key) {
-    while (*key) {
-        *dest++ = (char)tolower((unsigned char)*key++);
-    }
-    *dest = '\0';
+// Constants of `hash_table_seeded_hash`, taken from wyhash
+// [https://github.com/wangyi-fudan/wyhash].
+#define WY_P0 0xa0761d6478bd642full
+#define WY_P1 0xe7037ed1a0b428dbull
+#define WY_P2 0x8ebc6af09c88c6e3ull
+
+// Seed of `hash_table_seeded_hash`, fixed for the lifetime of the process.
+static uint64_t hash_seed;
+
+// Multiply `a` and `b` into 128 bits, returning both halves folded together.
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+    __extension__ unsigned __int128 r = (unsigned __int128)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a;
+    uint64_t hb = b >> 32, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+
+    return lo ^ hi;
+#endif
 }
 
-// Resize the given hash table. Returns (1) on successful resize, otherwise (0).
-static int hash_table_resize(hash_table_t *ht) {
-    key_val_t *local_entries = ht->entries;
-    uint32_t local_capacity = ht->capacity;
+// Returns `len` (at most 8) bytes of `str` as a word, zero-padded.
+static inline uint64_t load_word(const char *str, size_t len) {
+    uint64_t word = 0;
+    memcpy(&word, str, len);
+    return word;
+}
 
-    // Double capacity to ensure it remains a power-of-two.
-    key_val_t *new_entries = calloc(local_capacity * 2, sizeof(*new_entries));
-    if (!new_entries) {
-        perror("ERROR: hash_table_resize (calloc)");
-        return 0;
-    }
+// Returns `word` with each byte holding an uppercase ASCII letter converted to
+// lowercase, leaving all other bytes untouched.
+static inline uint64_t fold_word(uint64_t word) {
+    const uint64_t high = 0x8080808080808080ull;
 
-    ht->entries = new_entries;
-    ht->capacity *= 2;
+    // The high bit of each byte is set if it is at least 'A', and separately
+    // if it is above 'Z', without carrying into the next byte.
+    uint64_t low_bits = word & 0x7f7f7f7f7f7f7f7full;
+    uint64_t ge_a = low_bits + 0x3f3f3f3f3f3f3f3full;
+    uint64_t gt_z = low_bits + 0x2525252525252525ull;
 
-    // Set size to 0 before inserting previous entries.
-    ht->size = 0;
+    // Bytes with the high bit set are not ASCII.
+    uint64_t upper = ge_a & ~gt_z & ~word & high;
 
-    // Insert entries from previous allocation to new allocation, as each key
-    // needs to be rehashed to account for new capacity.
-    for (size_t i = 0; i < local_capacity; ++i) {
-        // Insert entries with non-NULL keys only.
-        if (local_entries[i].key) {
-            hash_table_insert(ht, local_entries[i].key, local_entries[i].value);
+    return word | (upper >> 2);
+}
 
-            // Clean up allocations for local key/value pairs.
-            free(local_entries[i].key);
-            free(local_entries[i].value);
+// Pick the seed of `hash_table_seeded_hash` before main() runs, so every table
+// of the process agrees on it.
+__attribute__((constructor)) static void hash_seed_init(void) {
+    uint64_t seed = 0;
+
+    FILE *urandom = fopen("/dev/urandom", "rb");
+    if (!urandom || fread(&seed, sizeof(seed), 1, urandom) != 1) {
+        // Without a source of randomness, use what differs between runs.
+        seed = (uint64_t)time(NULL) ^ (uint64_t)clock() ^
+               (uint64_t)(uintptr_t)&seed;
+    }
+
+    if (urandom) {
+        fclose(urandom);
+    }
+
+    hash_seed = mum(seed ^ WY_P0, WY_P1);
+}
+
+// Seeded hash of `key`, with ASCII letters folded to lowercase when `fold` is
+// set. Inlined into both public variants, so the fold is decided at compile
+// time.
+static inline uint64_t seeded_hash(const char *key, size_t key_len, int fold) {
+    uint64_t hash = hash_seed ^ mum(hash_seed ^ WY_P0, key_len ^ WY_P1);
+    size_t i = 0;
+
+    for (; key_len - i > 16; i += 16) {
+        uint64_t a = load_word(key + i, 8);
+        uint64_t b = load_word(key + i + 8, 8);
+        if (fold) {
+            a = fold_word(a);
+            b = fold_word(b);
         }
+        hash = mum(a ^ WY_P1, b ^ hash);
     }
 
-    free(local_entries);
-    return 1;
+    // The last 1 to 16 bytes, or none for an empty key.
+    size_t rest = key_len - i;
+    uint64_t a = load_word(key + i, rest < 8 ? rest : 8);
+    uint64_t b = rest > 8 ? load_word(key + i + 8, rest - 8) : 0;
+    if (fold) {
+        a = fold_word(a);
+        b = fold_word(b);
+    }
+
+    return mum(WY_P2 ^ key_len, mum(a ^ WY_P1, b ^ hash));
 }
 
-hash_table_t *hash_table_init(uint32_t capacity, ht_hash_fn hash_fn) {
-    assert((capacity & (capacity - 1)) == 0);
+uint64_t hash_table_seeded_hash(const char *key, size_t key_len) {
+    return seeded_hash(key, key_len, 1);
+}
 
-    hash_table_t *ht = malloc(sizeof(*ht));
-    if (!ht) {
-        perror("ERROR: hash_table_init (malloc)");
+uint64_t hash_table_seeded_binary_hash(const char *key, size_t key_len) {
+    return seeded_hash(key, key_len, 0);
+}
+
+// Allocate `size` bytes from `arena`. Returns a pointer to the allocation,
+// otherwise NULL with `errno` set, as malloc() would.
+static void *arena_alloc(ht_arena_t *arena, size_t size) {
+    uintptr_t top = (uintptr_t)(arena->buf + arena->used);
+    size_t pad = (size_t)(-top & (ARENA_ALIGN - 1));
+
+    if (size > arena->size - arena->used ||
+        pad > arena->size - arena->used - size) {
+        errno = ENOMEM;
         return NULL;
     }
 
-    ht->entries = calloc(capacity, sizeof(*ht->entries));
-    if (!ht->entries) {
-        perror("ERROR: hash_table_init (calloc)");
-        free(ht);
-        return NULL;
+    void *ptr = arena->buf + arena->used + pad;
+    arena->used += pad + size;
+
+    return ptr;
+}
+
+// Allocate `size` bytes for the given hash table, from its arena if it has
+// one. Returns a pointer to the allocation, otherwise NULL.
+static void *ht_alloc(hash_table_t *ht, size_t size) {
+    return ht->arena ? arena_alloc(ht->arena, size) : malloc(size);
+}
+
+// Returns the number of slots in the entries of the given hash table.
+static inline uint32_t ht_slots(const hash_table_t *ht) {
+    return ht->small ? SMALL_SIZE : ht->capacity;
+}
+
+// Returns the number of bytes used by `capacity` entries of the given hash
+// table, including any control bytes following them.
+static size_t entries_size(const hash_table_t *ht, uint32_t capacity) {
+    size_t size = capacity * sizeof(key_val_t);
+
+    // The first group of control bytes is repeated past the end, so a group
+    // can be loaded from any slot without wrapping.
+    if (ht->probe == HT_PROBE_SWISS && !ht->small) {
+        size += capacity + GROUP_WIDTH;
     }
 
-    ht->hash_fn = hash_fn ? hash_fn : fnv_1a_hash;
-    ht->capacity = capacity;
-    ht->size = 0;
+    return size;
+}
 
-    return ht;
+// Allocate `capacity` zeroed entries for the given hash table. Returns a
+// pointer to the entries, otherwise NULL.
+static key_val_t *ht_alloc_entries(hash_table_t *ht, uint32_t capacity) {
+    size_t size = entries_size(ht, capacity);
+
+    if (!ht->arena) {
+        return calloc(1, size);
+    }
+
+    key_val_t *entries = arena_alloc(ht->arena, size);
+    if (entries) {
+        memset(entries, 0, size);
+    }
+
+    return entries;
 }
 
-void hash_table_free(hash_table_t *ht) {
-    assert(ht);
+// Release an allocation made by `ht_alloc`. Arena allocations are only
+// reclaimed by `hash_table_reset`.
+static void ht_release(hash_table_t *ht, void *ptr) {
+    if (!ht->arena) {
+        free(ptr);
+    }
+}
 
-    if (ht->entries) {
-        if (ht->size > 0) {
-            for (size_t i = 0; i < ht->capacity; ++i) {
-                free(ht->entries[i].key);
-                free(ht->entries[i].value);
-            }
-        }
+// Point the given hash table at `entries`, which hold `capacity` slots unless
+// they are the small vector.
+static void ht_set_entries(hash_table_t *ht, key_val_t *entries,
+                           uint32_t capacity) {
+    ht->entries = entries;
+    ht->capacity = capacity;
+    ht->ctrl = ht->probe == HT_PROBE_SWISS && !ht->small
+                   ? (uint8_t *)(entries + capacity)
+                   : NULL;
+}
 
-        free(ht->entries);
+// Release the key and every value of `entry`.
+static void entry_release(hash_table_t *ht, key_val_t *entry) {
+    ht_release(ht, entry->key);
+    ht_release(ht, entry->value);
+
+    if (!entry->values) {
+        return;
     }
 
-    free(ht);
+    ht_value_t *node = entry->values->head;
+    while (node) {
+        ht_value_t *next = node->next;
+        ht_release(ht, node);
+        node = next;
+    }
+
+    ht_release(ht, entry->values->joined);
+    ht_release(ht, entry->values);
 }
 
-int hash_table_insert(hash_table_t *ht, const char *key, const char *value) {
-    assert(ht && key && value);
+// Add `value` of `val_len` bytes after the values of `entry`. Only the new
+// value is copied. Returns (1) on success, otherwise (0).
+static int entry_append(hash_table_t *ht, key_val_t *entry, const char *value,
+                        size_t val_len) {
+    ht_values_t *values = entry->values;
 
-    if (ht->size >= LOAD_FACTOR * ht->capacity) {
-        if (hash_table_resize(ht) == 0) {
+    if (!values) {
+        values = ht_alloc(ht, sizeof(ht_values_t));
+        if (!values) {
+            perror("ERROR: hash_table_insert (malloc)");
             return 0;
         }
-    }
 
-    size_t key_len = strlen(key);
-    size_t val_len = strlen(value);
+        values->head = NULL;
+        values->tail = NULL;
+        values->joined = NULL;
+        values->joined_len = strlen(entry->value);
+        values->count = 1;
 
-    char *alloc_key = malloc(key_len + 1);
-    if (!alloc_key) {
-        perror("ERROR: hash_table_insert (malloc)");
-        return 0;
+        entry->values = values;
     }
 
-    char *alloc_val = malloc(val_len + 1);
-    if (!alloc_val) {
+    ht_value_t *node = ht_alloc(ht, sizeof(ht_value_t) + val_len + 1);
+    if (!node) {
         perror("ERROR: hash_table_insert (malloc)");
         return 0;
     }
 
-    memcpy(alloc_key, key, key_len + 1);
-    memcpy(alloc_val, value, val_len + 1);
+    node->next = NULL;
+    node->len = val_len;
+    memcpy(node->value, value, val_len + 1);
 
-    // Allocate memory for provided key/value pair.
-    key_val_t kv = {.key = alloc_key, .value = alloc_val, .is_deleted = 0};
+    if (values->tail) {
+        values->tail->next = node;
+    } else {
+        values->head = node;
+    }
 
-    // Convert key to lowercase to ensure lookups are case-insensitive
-    key_to_lower(alloc_key, key);
+    values->tail = node;
 
-    // Ensures index is within range [0, capacity - 1].
-    size_t idx = ht->hash_fn(alloc_key, key_len) & (ht->capacity - 1);
+    // +2 for the comma and space characters.
+    values->joined_len += val_len + 2;
+    values->count++;
 
-#ifdef _DEBUG
-    printf("hash_table_insert: computed_idx = %lu\tkey = %s\n", idx, key);
-#endif
+    // The joined list no longer holds every value.
+    ht_release(ht, values->joined);
+    values->joined = NULL;
+
+    return 1;
+}
 
-    for (size_t i = 1; i < ht->capacity && ht->entries[idx].key; ++i) {
-        // Duplicate key found - update the value of the key, appending values
-        // in comma separated list.
-        if (strcmp(ht->entries[idx].key, alloc_key) == 0) {
-            char *new_value = kv.value;
-            char *prev_value = ht->entries[idx].value;
+// Returns the length of the value of `entry`, with any later values joined.
+static size_t entry_value_len(const key_val_t *entry) {
+    return entry->values ? entry->values->joined_len : strlen(entry->value);
+}
 
-            size_t prev_val_len = strlen(prev_value);
+// Copy the values of `entry`, joined in a comma-separated list, to `dest`
+// followed by a null-terminator.
+static void entry_join(const key_val_t *entry, char *dest) {
+    size_t len = strlen(entry->value);
+    memcpy(dest, entry->value, len);
 
-            // +3 for null-terminator byte, comma, and space characters.
-            char *append_value = malloc(prev_val_len + val_len + 3);
-            if (!append_value) {
-                perror("ERROR: hash_table_insert (malloc)");
-                return 0;
-            }
+    for (const ht_value_t *node = entry->values ? entry->values->head : NULL;
+         node; node = node->next) {
+        dest[len++] = ',';
+        dest[len++] = ' ';
 
-            memcpy(append_value, prev_value, prev_val_len);
-            append_value[prev_val_len] = ',';
-            append_value[++prev_val_len] = ' ';
-            append_value[++prev_val_len] = '\0';
+        memcpy(dest + len, node->value, node->len);
+        len += node->len;
+    }
 
-            memcpy(append_value + prev_val_len, new_value, val_len);
-            append_value[prev_val_len + val_len] = '\0';
+    dest[len] = '\0';
+}
 
-            // Clean up allocations for previous key/value pair.
-            free(ht->entries[idx].key);
-            free(prev_value);
-            free(new_value);
+// Returns the value of `entry`, joining any later values on first use after an
+// insertion. Returns NULL if the joined list could not be allocated.
+static char *entry_value(hash_table_t *ht, key_val_t *entry) {
+    ht_values_t *values = entry->values;
 
-            kv.value = append_value;
+    if (!values) {
+        return entry->value;
+    }
 
-            ht->entries[idx] = kv;
-            return 1;
+    if (!values->joined) {
+        values->joined = ht_alloc(ht, values->joined_len + 1);
+        if (!values->joined) {
+            perror("ERROR: hash_table_lookup (malloc)");
+            return NULL;
         }
 
-        // Using `open addressing` with `quadratic probing` to handle
-        // collisions. This approach uses less memory than external chaining by
-        // storing all entries in same array, with the downsides of needing to
-        // resize and potential clustering.
-        size_t probe_offset = ((i * i) + i);
-        // Ensures index properly wraps back to 0.
-        idx = (idx + probe_offset) & (ht->capacity - 1);
+        entry_join(entry, values->joined);
     }
 
-    // Same preference for initially NULL slots or slots marked as deleted.
-    ht->entries[idx] = kv;
-    ht->size++;
+    return values->joined;
+}
 
-    return 1;
+// Copies the `key_len` bytes of `key` to `dest` with ASCII letters converted
+// to lowercase, then null-terminates `dest`.
+static void key_to_lower(char *dest, const char *key, size_t key_len) {
+    size_t i = 0;
+
+    for (; i + 8 <= key_len; i += 8) {
+        uint64_t word = fold_word(load_word(key + i, 8));
+        memcpy(dest + i, &word, 8);
+    }
+
+    for (; i < key_len; ++i) {
+        char c = key[i];
+        dest[i] = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+    }
+
+    dest[key_len] = '\0';
 }
 
-char *hash_table_lookup(hash_table_t *ht, const char *key) {
-    assert(ht && key);
+// Returns (1) if the stored lowercase key `lower` equals the first `key_len`
+// bytes of `key` ignoring ASCII case, otherwise (0).
+static inline int key_fold_equal(const char *lower, const char *key,
+                                 size_t key_len) {
+    size_t i = 0;
 
-    size_t key_len = strlen(key);
+    for (; i + 8 <= key_len; i += 8) {
+        if (fold_word(load_word(key + i, 8)) != load_word(lower + i, 8)) {
+            return 0;
+        }
+    }
 
-    // Convert key to lowercase to ensure lookups are case-insensitive
-    char lower_key[key_len + 1];
-    key_to_lower(lower_key, key);
+    return key_len == i || fold_word(load_word(key + i, key_len - i)) ==
+                               load_word(lower + i, key_len - i);
+}
 
-    // Ensures index is within range [0, capacity - 1].
-    size_t idx = ht->hash_fn(lower_key, key_len) & (ht->capacity - 1);
+// Computes the hash `hash_fn` gives the lowercase form of `key` into `hash`.
+// The seeded hash folds case itself, other hash functions are given a
+// lowercase copy. Returns (1) on success, otherwise (0) if the copy could not
+// be allocated.
+static int key_hash(ht_hash_fn hash_fn, const char *key, size_t key_len,
+                    uint64_t *hash) {
+    if (hash_fn == hash_table_seeded_hash) {
+        *hash = hash_table_seeded_hash(key, key_len);
+        return 1;
+    }
 
-#ifdef _DEBUG
-    printf("hash_table_lookup: computed_idx = %lu\tkey = %s\n", idx, key);
-#endif
+    char stack_buf[FOLD_STACK_SIZE];
+    char *lower = stack_buf;
+
+    if (key_len >= FOLD_STACK_SIZE) {
+        lower = malloc(key_len + 1);
+        if (!lower) {
+            return 0;
+        }
+    }
+
+    key_to_lower(lower, key, key_len);
+    *hash = hash_fn(lower, key_len);
+
+    if (lower != stack_buf) {
+        free(lower);
+    }
+
+    return 1;
+}
+
+// Returns (1) if `entry` holds `key` of `key_len` bytes, ignoring case, with
+// the given `hash`, otherwise (0). The key bytes are only compared once both
+// the hash and length match.
+static inline int entry_matches(const key_val_t *entry, const char *key,
+                                size_t key_len, uint64_t hash) {
+    return entry->hash == hash && entry->key_len == key_len &&
+           key_fold_equal(entry->key, key, key_len);
+}
+
+// Returns the index of `key` in the given hash table, otherwise SIZE_MAX. When
+// `relocate` is set, a key found past a tombstone is moved into the first
+// tombstone of its probing sequence.
+static size_t quadratic_find(hash_table_t *ht, const char *key, size_t key_len,
+                             uint64_t hash, int relocate) {
+    // Ensures index is within range [0, capacity - 1].
+    size_t idx = hash & (ht->capacity - 1);
 
     // Track of the index of first tombstone marker found.
     size_t first_tomb_idx = SIZE_MAX;
 
     // Set `i` to 0 so indices can be computed at the beginning of the loop.
     for (size_t i = 0; i < ht->capacity; ++i) {
-        size_t probe_offset = ((i * i) + i); /* Quadratic probing */
+        // Using `open addressing` with `quadratic probing` to handle
+        // collisions. This approach uses less memory than external chaining by
+        // storing all entries in same array, with the downsides of needing to
+        // resize and potential clustering. Offsets grow by one each step, so
+        // slots are visited at triangular numbers from the home slot, which
+        // covers every slot of a power-of-two capacity.
+        size_t probe_offset = i;
         // Ensures index properly wraps back to 0.
         idx = (idx + probe_offset) & (ht->capacity - 1);
 
@@ -247,10 +517,9 @@ char *hash_table_lookup(hash_table_t *ht, const char *key) {
         }
 
         // Key found
-        if (strcmp(ht->entries[idx].key, lower_key) == 0) {
-            if (first_tomb_idx == SIZE_MAX) {
-                // No tombstone marker found - return value directly.
-                return ht->entries[idx].value;
+        if (entry_matches(&ht->entries[idx], key, key_len, hash)) {
+            if (!relocate || first_tomb_idx == SIZE_MAX) {
+                return idx;
             }
 
             // By setting the key/value pair to the first tombstone index,
@@ -258,88 +527,925 @@ char *hash_table_lookup(hash_table_t *ht, const char *key) {
             // the entire probing sequence.
             ht->entries[first_tomb_idx] = ht->entries[idx];
 
-            // Mark key's previous slot as empty
+            // Mark key's previous slot as a tombstone, as other keys may
+            // still probe past it.
             ht->entries[idx].key = NULL;
             ht->entries[idx].value = NULL;
+            ht->entries[idx].values = NULL;
+            ht->entries[idx].is_deleted = 1;
 
-            return ht->entries[first_tomb_idx].value;
+            return first_tomb_idx;
         }
     }
 
-    return NULL;
+    return SIZE_MAX;
 }
 
-int hash_table_delete(hash_table_t *ht, const char *key) {
-    assert(ht && key);
+// Returns the index of the first free slot, empty or deleted, along the
+// probing sequence of `hash`, otherwise SIZE_MAX.
+static size_t quadratic_claim(hash_table_t *ht, uint64_t hash) {
+    size_t idx = hash & (ht->capacity - 1);
 
-    size_t key_len = strlen(key);
+    for (size_t i = 0; i < ht->capacity; ++i) {
+        size_t probe_offset = i; /* Quadratic probing */
+        idx = (idx + probe_offset) & (ht->capacity - 1);
 
-    // Convert key to lowercase to ensure lookups are case-insensitive
-    char lower_key[key_len + 1];
-    key_to_lower(lower_key, key);
+        if (!ht->entries[idx].key) {
+            if (ht->entries[idx].is_deleted) {
+                ht->tombstones--;
+            }
 
-    // Ensures index is within range [0, capacity - 1].
-    size_t idx = ht->hash_fn(lower_key, key_len) & (ht->capacity - 1);
+            return idx;
+        }
+    }
 
-#ifdef _DEBUG
-    printf("hash_table_delete: computed_idx = %lu\tkey = %s\n", idx, key);
+    return SIZE_MAX;
+}
+
+// Returns a bitmask of the slots in the group of control bytes at `ctrl` equal
+// to `byte`, with bit N set for slot N of the group.
+static inline unsigned group_match(const uint8_t *ctrl, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (unsigned)(ctrl[i] == byte) << i;
+    }
+    return mask;
 #endif
+}
 
-    // Set `i` to 0 so indices can be computed at the beginning of the loop.
-    for (size_t i = 0; i < ht->capacity; ++i) {
-        size_t probe_offset = ((i * i) + i); /* Quadratic probing */
-        // Ensures index properly wraps back to 0.
-        idx = (idx + probe_offset) & (ht->capacity - 1);
+// Returns a bitmask of the free slots, empty or deleted, in the group of
+// control bytes at `ctrl`.
+static inline unsigned group_match_free(const uint8_t *ctrl) {
+#ifdef __SSE2__
+    // Occupied slots are exactly those with the high bit set.
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return ~(unsigned)_mm_movemask_epi8(group) & 0xffff;
+#else
+    unsigned mask = 0;
+    for (unsigned i = 0; i < GROUP_WIDTH; ++i) {
+        mask |= (unsigned)!(ctrl[i] & CTRL_FULL) << i;
+    }
+    return mask;
+#endif
+}
 
-        // Ensure tombstones are checked before NULL entries to maintain probing
-        // sequence.
-        if (ht->entries[idx].is_deleted) {
-            // Tombstone (deleted) slot found - continue with probing sequence.
-            continue;
+// Set the control byte of slot `idx`, along with its copy past the end of the
+// control bytes when it is one of the first group.
+static inline void swiss_set_ctrl(hash_table_t *ht, size_t idx, uint8_t byte) {
+    ht->ctrl[idx] = byte;
+    ht->ctrl[((idx - GROUP_WIDTH) & (ht->capacity - 1)) + GROUP_WIDTH] = byte;
+}
+
+// Returns the index of `key` in the given hash table, otherwise SIZE_MAX.
+static size_t swiss_find(const hash_table_t *ht, const char *key,
+                         size_t key_len, uint64_t hash) {
+    size_t mask = ht->capacity - 1;
+    size_t pos = (size_t)(hash >> 7) & mask;
+    uint8_t h2 = (uint8_t)(CTRL_FULL | (hash & 0x7f));
+
+    // Groups are probed at triangular offsets, which visits every group of a
+    // power-of-two capacity.
+    for (size_t step = GROUP_WIDTH; step <= ht->capacity; step += GROUP_WIDTH) {
+        const uint8_t *group = ht->ctrl + pos;
+
+        // Only entries whose control byte matches 7 bits of the hash are read.
+        for (unsigned match = group_match(group, h2); match;
+             match &= match - 1) {
+            size_t idx = (pos + (size_t)__builtin_ctz(match)) & mask;
+            if (entry_matches(&ht->entries[idx], key, key_len, hash)) {
+                return idx;
+            }
         }
 
-        if (!ht->entries[idx].key) {
+        // Keys are never placed past a group with an empty slot.
+        if (group_match(group, CTRL_EMPTY)) {
             break;
         }
 
-        // Key found
-        if (strcmp(ht->entries[idx].key, lower_key) == 0) {
-            // Clean up allocations.
-            free(ht->entries[idx].key);
-            free(ht->entries[idx].value);
+        pos = (pos + step) & mask;
+    }
 
-            // Set values to NULL to indicate slot is empty.
-            ht->entries[idx].key = NULL;
-            ht->entries[idx].value = NULL;
+    return SIZE_MAX;
+}
 
-            // Also mark entry as deleted for future lookup/deletions.
-            ht->entries[idx].is_deleted = 1;
+// Returns the index of the first free slot, empty or deleted, along the
+// probing sequence of `hash`, marking it as holding an entry with the hash.
+// Otherwise returns SIZE_MAX.
+static size_t swiss_claim(hash_table_t *ht, uint64_t hash) {
+    size_t mask = ht->capacity - 1;
+    size_t pos = (size_t)(hash >> 7) & mask;
 
-            ht->size--;
-            return 1;
+    for (size_t step = GROUP_WIDTH; step <= ht->capacity; step += GROUP_WIDTH) {
+        unsigned free_mask = group_match_free(ht->ctrl + pos);
+
+        if (free_mask) {
+            size_t idx = (pos + (size_t)__builtin_ctz(free_mask)) & mask;
+            if (ht->ctrl[idx] == CTRL_DELETED) {
+                ht->tombstones--;
+            }
+
+            swiss_set_ctrl(ht, idx, (uint8_t)(CTRL_FULL | (hash & 0x7f)));
+            return idx;
         }
+
+        pos = (pos + step) & mask;
     }
 
-    return 0;
+    return SIZE_MAX;
 }
 
-void hash_table_debug_print(const hash_table_t *ht) {
-    assert(ht);
+// Returns the distance of the entry at `idx` from its home slot.
+static inline size_t robin_dist(const hash_table_t *ht, size_t idx) {
+    return (idx - (size_t)ht->entries[idx].hash) & (ht->capacity - 1);
+}
 
-    for (size_t i = 0; i < ht->capacity; ++i) {
-        key_val_t entry = ht->entries[i];
-#ifdef _DEBUG
-        if (entry.key && !entry.is_deleted) {
-            printf("[%zu]\t\"%s\" : \"%s\"\n", i, entry.key, entry.value);
-        } else if (!entry.key && !entry.is_deleted) {
-            printf("[%zu]\t\"(null)\" : \"(null)\"\n", i);
-        } else {
-            printf("[%zu]\t\"(tombstone)\" : \"(tombstone)\"\n", i);
+// Returns the index of `key` in the given hash table, otherwise SIZE_MAX.
+static size_t robin_find(const hash_table_t *ht, const char *key,
+                         size_t key_len, uint64_t hash) {
+    size_t mask = ht->capacity - 1;
+    size_t idx = hash & mask;
+
+    for (size_t dist = 0; dist < ht->capacity; ++dist) {
+        if (!ht->entries[idx].key) {
+            break;
         }
-#else
-        if (entry.key) {
-            printf("- \"%s\": \"%s\"\n", entry.key, entry.value);
+
+        // Entries are ordered by distance from home, so the key would have
+        // displaced any entry closer to its own home than the key would be.
+        if (robin_dist(ht, idx) < dist) {
+            break;
         }
-#endif
+
+        if (entry_matches(&ht->entries[idx], key, key_len, hash)) {
+            return idx;
+        }
+
+        idx = (idx + 1) & mask;
     }
+
+    return SIZE_MAX;
+}
+
+// Returns the index of the slot for a new entry with the given `hash`, which is
+// either empty or the first holding an entry closer to its home. In the latter
+// case, entries up to the next empty slot are shifted forward by one to make
+// room, which keeps them ordered by distance. Otherwise returns SIZE_MAX.
+static size_t robin_claim(hash_table_t *ht, uint64_t hash) {
+    size_t mask = ht->capacity - 1;
+    size_t idx = hash & mask;
+
+    for (size_t dist = 0; dist < ht->capacity; ++dist) {
+        if (!ht->entries[idx].key) {
+            return idx;
+        }
+
+        if (robin_dist(ht, idx) < dist) {
+            size_t end = idx;
+            while (ht->entries[end].key) {
+                end = (end + 1) & mask;
+            }
+
+            for (; end != idx; end = (end - 1) & mask) {
+                ht->entries[end] = ht->entries[(end - 1) & mask];
+            }
+
+            return idx;
+        }
+
+        idx = (idx + 1) & mask;
+    }
+
+    return SIZE_MAX;
+}
+
+// Empty slot `idx` of the given hash table, shifting back each following
+// entry that is away from its home slot.
+static void robin_vacate(hash_table_t *ht, size_t idx) {
+    size_t mask = ht->capacity - 1;
+
+    for (size_t next = (idx + 1) & mask;
+         ht->entries[next].key && robin_dist(ht, next) > 0;
+         next = (next + 1) & mask) {
+        ht->entries[idx] = ht->entries[next];
+        idx = next;
+    }
+
+    memset(&ht->entries[idx], 0, sizeof(key_val_t));
+}
+
+// Returns the index of `key` in the small vector of the given hash table,
+// otherwise SIZE_MAX.
+static size_t small_find(const hash_table_t *ht, const char *key,
+                         size_t key_len, uint64_t hash) {
+    for (size_t i = 0; i < ht->size; ++i) {
+        if (entry_matches(&ht->entries[i], key, key_len, hash)) {
+            return i;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+// Returns the index of the lowercase `key` in the current storage of the given
+// hash table, otherwise SIZE_MAX. See `quadratic_find` for `relocate`.
+static size_t storage_find(hash_table_t *ht, const char *key, size_t key_len,
+                           uint64_t hash, int relocate) {
+    if (ht->small) {
+        return small_find(ht, key, key_len, hash);
+    }
+
+    switch (ht->probe) {
+        case HT_PROBE_SWISS:
+            return swiss_find(ht, key, key_len, hash);
+        case HT_PROBE_ROBIN_HOOD:
+            return robin_find(ht, key, key_len, hash);
+        default:
+            return quadratic_find(ht, key, key_len, hash, relocate);
+    }
+}
+
+// Returns the index of a free slot for a new entry with the given `hash`.
+static size_t hash_table_claim(hash_table_t *ht, uint64_t hash) {
+    // New entries are appended to the small vector.
+    if (ht->small) {
+        return ht->size < SMALL_SIZE ? ht->size : SIZE_MAX;
+    }
+
+    size_t idx;
+    switch (ht->probe) {
+        case HT_PROBE_SWISS:
+            idx = swiss_claim(ht, hash);
+            break;
+        case HT_PROBE_ROBIN_HOOD:
+            idx = robin_claim(ht, hash);
+            break;
+        default:
+            idx = quadratic_claim(ht, hash);
+            break;
+    }
+
+    // The load factor keeps free slots in every table.
+    assert(idx != SIZE_MAX);
+    return idx;
+}
+
+// Mark slot `idx` of the hashed storage of the given hash table as deleted,
+// once its entry was moved elsewhere or released.
+static void hash_table_vacate(hash_table_t *ht, size_t idx) {
+    if (ht->probe == HT_PROBE_ROBIN_HOOD) {
+        robin_vacate(ht, idx);
+        return;
+    }
+
+    // Set values to NULL to indicate slot is empty.
+    ht->entries[idx].key = NULL;
+    ht->entries[idx].value = NULL;
+    ht->entries[idx].values = NULL;
+
+    // Also mark entry as deleted for future lookup/deletions.
+    ht->entries[idx].is_deleted = 1;
+
+    if (ht->probe == HT_PROBE_SWISS) {
+        swiss_set_ctrl(ht, idx, CTRL_DELETED);
+    }
+}
+
+// Returns a copy of the given hash table pointing at the storage its entries
+// are being migrated away from, which is then probed as any other table.
+static hash_table_t migrating_view(const hash_table_t *ht) {
+    hash_table_t view = *ht;
+
+    view.small = 0;
+    view.old_entries = NULL;
+    ht_set_entries(&view, ht->old_entries, ht->old_capacity);
+
+    return view;
+}
+
+// Move up to `slots` slots of the storage being migrated away from into the
+// current storage of the given hash table, releasing it once all are moved.
+static void hash_table_migrate(hash_table_t *ht, uint32_t slots) {
+    hash_table_t view = migrating_view(ht);
+
+    for (; slots > 0 && ht->migrated < ht->old_capacity; --slots) {
+        size_t i = ht->migrated;
+
+        // As on a full resize, entries are moved with their stored hash.
+        if (view.entries[i].key) {
+            size_t idx = hash_table_claim(ht, view.entries[i].hash);
+            ht->entries[idx] = view.entries[i];
+
+            // Keys not moved yet may still probe past this slot.
+            hash_table_vacate(&view, i);
+        }
+
+        // Unless deletion shifted the next entry back into this slot.
+        if (!view.entries[i].key) {
+            ht->migrated++;
+        }
+    }
+
+    if (ht->migrated == ht->old_capacity) {
+        ht_release(ht, ht->old_entries);
+        ht->old_entries = NULL;
+    }
+}
+
+// Returns the index of the lowercase `key` in the given hash table, otherwise
+// SIZE_MAX. A key still in the storage being migrated away from is moved into
+// the current storage first. See `quadratic_find` for `relocate`.
+static size_t hash_table_find(hash_table_t *ht, const char *key,
+                              size_t key_len, uint64_t hash, int relocate) {
+    size_t idx = storage_find(ht, key, key_len, hash, relocate);
+    if (idx != SIZE_MAX || !ht->old_entries) {
+        return idx;
+    }
+
+    hash_table_t view = migrating_view(ht);
+
+    size_t old_idx = storage_find(&view, key, key_len, hash, 0);
+    if (old_idx == SIZE_MAX) {
+        return SIZE_MAX;
+    }
+
+    idx = hash_table_claim(ht, hash);
+    ht->entries[idx] = view.entries[old_idx];
+    hash_table_vacate(&view, old_idx);
+
+    return idx;
+}
+
+// Remove the entry at `idx` of the given hash table, leaving a tombstone in
+// hashed storage other than (HT_PROBE_ROBIN_HOOD).
+static void hash_table_erase(hash_table_t *ht, size_t idx) {
+    // Clean up allocations.
+    entry_release(ht, &ht->entries[idx]);
+
+    // The last entry of the small vector takes the place of the removed one,
+    // keeping entries at its start.
+    if (ht->small) {
+        ht->size--;
+        ht->entries[idx] = ht->entries[ht->size];
+        memset(&ht->entries[ht->size], 0, sizeof(key_val_t));
+        return;
+    }
+
+    hash_table_vacate(ht, idx);
+
+    ht->size--;
+    if (ht->probe != HT_PROBE_ROBIN_HOOD) {
+        ht->tombstones++;
+    }
+}
+
+// Move every entry of the given hash table into a new allocation of `capacity`
+// slots, dropping any tombstones. Returns (1) on success, otherwise (0).
+static int hash_table_rehash(hash_table_t *ht, uint32_t capacity) {
+    key_val_t *local_entries = ht->entries;
+    uint32_t local_capacity = ht_slots(ht);
+    int local_small = ht->small;
+
+    // Entries always leave the small vector for hashed storage.
+    ht->small = 0;
+
+    key_val_t *new_entries = ht_alloc_entries(ht, capacity);
+    if (!new_entries) {
+        perror("ERROR: hash_table_resize (calloc)");
+        ht->small = local_small;
+        return 0;
+    }
+
+    ht_set_entries(ht, new_entries, capacity);
+    ht->tombstones = 0;
+
+    // Move entries from previous allocation to new allocation. Each key needs
+    // a new slot to account for new capacity, found from its stored hash, but
+    // the key and value themselves are kept as they are.
+    for (size_t i = 0; i < local_capacity; ++i) {
+        // Move entries with non-NULL keys only, leaving tombstones behind.
+        if (local_entries[i].key) {
+            size_t idx = hash_table_claim(ht, local_entries[i].hash);
+            new_entries[idx] = local_entries[i];
+        }
+    }
+
+    ht_release(ht, local_entries);
+    return 1;
+}
+
+// Resize the given hash table. Returns (1) on successful resize, otherwise (0).
+static int hash_table_resize(hash_table_t *ht) {
+    uint32_t capacity = ht->capacity;
+
+    // A full small vector moves to hashed storage of at least the requested
+    // capacity, grown until its entries are within the load factor.
+    if (ht->small) {
+        while (ht->size >= LOAD_FACTOR * capacity) {
+            capacity *= 2;
+        }
+
+        return hash_table_rehash(ht, capacity);
+    }
+
+    // The current storage filled up before the previous migration completed.
+    if (ht->old_entries) {
+        hash_table_migrate(ht, UINT32_MAX);
+    }
+
+    // Double capacity to ensure it remains a power-of-two, unless most of the
+    // load is tombstones, which are dropped by rehashing at the same capacity.
+    if (ht->size >= LOAD_FACTOR * capacity / 2) {
+        capacity *= 2;
+    }
+
+    if (!ht->incremental) {
+        return hash_table_rehash(ht, capacity);
+    }
+
+    // Entries are moved by subsequent operations instead.
+    key_val_t *new_entries = ht_alloc_entries(ht, capacity);
+    if (!new_entries) {
+        perror("ERROR: hash_table_resize (calloc)");
+        return 0;
+    }
+
+    ht->old_entries = ht->entries;
+    ht->old_capacity = ht->capacity;
+    ht->migrated = 0;
+
+    ht_set_entries(ht, new_entries, capacity);
+    ht->tombstones = 0;
+
+    return 1;
+}
+
+hash_table_t *hash_table_init_opts(uint32_t capacity, const ht_opts_t *opts) {
+    assert((capacity & (capacity - 1)) == 0);
+
+    static const ht_opts_t default_opts = {0};
+    if (!opts) {
+        opts = &default_opts;
+    }
+
+    // Groups of control bytes must not be larger than the table.
+    if (opts->probe == HT_PROBE_SWISS && capacity < GROUP_WIDTH) {
+        capacity = GROUP_WIDTH;
+    }
+
+    ht_arena_t *arena = opts->arena;
+    size_t used = arena ? arena->used : 0;
+
+    hash_table_t *ht =
+        arena ? arena_alloc(arena, sizeof(*ht)) : malloc(sizeof(*ht));
+    if (!ht) {
+        perror("ERROR: hash_table_init (malloc)");
+        return NULL;
+    }
+
+    ht->arena = arena;
+    ht->probe = opts->probe;
+    ht->small = 1;
+    ht->incremental = opts->incremental;
+    ht->old_entries = NULL;
+    ht->old_capacity = 0;
+    ht->migrated = 0;
+
+    key_val_t *entries = ht_alloc_entries(ht, SMALL_SIZE);
+    if (!entries) {
+        perror("ERROR: hash_table_init (calloc)");
+        if (arena) {
+            arena->used = used;
+        } else {
+            free(ht);
+        }
+        return NULL;
+    }
+
+    ht_set_entries(ht, entries, capacity);
+    ht->hash_fn = opts->hash_fn ? opts->hash_fn : hash_table_seeded_hash;
+    ht->arena_mark = arena ? arena->used : 0;
+    ht->init_entries = entries;
+    ht->init_capacity = capacity;
+    ht->size = 0;
+    ht->tombstones = 0;
+
+    return ht;
+}
+
+hash_table_t *hash_table_init(uint32_t capacity, ht_hash_fn hash_fn) {
+    ht_opts_t opts = {.hash_fn = hash_fn};
+    return hash_table_init_opts(capacity, &opts);
+}
+
+hash_table_t *hash_table_init_arena(uint32_t capacity, ht_hash_fn hash_fn,
+                                    ht_arena_t *arena) {
+    assert(arena && arena->used <= arena->size);
+
+    ht_opts_t opts = {.hash_fn = hash_fn, .arena = arena};
+    return hash_table_init_opts(capacity, &opts);
+}
+
+void hash_table_free(hash_table_t *ht) {
+    assert(ht);
+
+    if (ht->arena) {
+        return;
+    }
+
+    // Entries of an incomplete resize are released with the rest.
+    if (ht->old_entries) {
+        hash_table_migrate(ht, UINT32_MAX);
+    }
+
+    if (ht->entries) {
+        if (ht->size > 0) {
+            for (size_t i = 0; i < ht_slots(ht); ++i) {
+                entry_release(ht, &ht->entries[i]);
+            }
+        }
+
+        free(ht->entries);
+    }
+
+    free(ht);
+}
+
+void hash_table_reset(hash_table_t *ht) {
+    assert(ht);
+
+    if (ht->arena) {
+        // Everything allocated since the table was created, including entries
+        // from any resize, is discarded at once.
+        ht->arena->used = ht->arena_mark;
+        ht->small = 1;
+        ht->old_entries = NULL;
+        ht_set_entries(ht, ht->init_entries, ht->init_capacity);
+    } else if (ht->size > 0) {
+        if (ht->old_entries) {
+            hash_table_migrate(ht, UINT32_MAX);
+        }
+
+        for (size_t i = 0; i < ht_slots(ht); ++i) {
+            entry_release(ht, &ht->entries[i]);
+        }
+    }
+
+    memset(ht->entries, 0, entries_size(ht, ht_slots(ht)));
+    ht->size = 0;
+    ht->tombstones = 0;
+}
+
+int hash_table_insert(hash_table_t *ht, const char *key, const char *value) {
+    assert(ht && key && value);
+
+    if (ht->old_entries) {
+        hash_table_migrate(ht, MIGRATE_STEP);
+    }
+
+    size_t key_len = strlen(key);
+    size_t val_len = strlen(value);
+
+    if (key_len > UINT32_MAX) {
+        return 0;
+    }
+
+    uint64_t hash;
+    if (!key_hash(ht->hash_fn, key, key_len, &hash)) {
+        perror("ERROR: hash_table_insert (malloc)");
+        return 0;
+    }
+
+#ifdef _DEBUG
+    printf("hash_table_insert: computed_idx = %lu\tkey = %s\n",
+           (size_t)(hash & (ht->capacity - 1)), key);
+#endif
+
+    // Duplicate key found - the new value is kept after the previous values,
+    // which are left where they are.
+    size_t idx = hash_table_find(ht, key, key_len, hash, 0);
+    if (idx != SIZE_MAX) {
+        return entry_append(ht, &ht->entries[idx], value, val_len);
+    }
+
+    // Tombstones lengthen probing sequences just as entries do.
+    if (ht->small ? ht->size == SMALL_SIZE
+                  : ht->size + ht->tombstones >= LOAD_FACTOR * ht->capacity) {
+        if (hash_table_resize(ht) == 0) {
+            return 0;
+        }
+    }
+
+    char *alloc_key = ht_alloc(ht, key_len + 1);
+    if (!alloc_key) {
+        perror("ERROR: hash_table_insert (malloc)");
+        return 0;
+    }
+
+    char *alloc_val = ht_alloc(ht, val_len + 1);
+    if (!alloc_val) {
+        perror("ERROR: hash_table_insert (malloc)");
+        ht_release(ht, alloc_key);
+        return 0;
+    }
+
+    memcpy(alloc_val, value, val_len + 1);
+
+    // Convert key to lowercase to ensure lookups are case-insensitive
+    key_to_lower(alloc_key, key, key_len);
+
+    // Allocate memory for provided key/value pair.
+    key_val_t kv = {.key = alloc_key,
+                    .value = alloc_val,
+                    .values = NULL,
+                    .hash = hash,
+                    .key_len = (uint32_t)key_len,
+                    .is_deleted = 0};
+
+    // Same preference for initially NULL slots or slots marked as deleted.
+    idx = hash_table_claim(ht, kv.hash);
+    ht->entries[idx] = kv;
+    ht->size++;
+
+    return 1;
+}
+
+char *hash_table_lookup(hash_table_t *ht, const char *key) {
+    assert(ht && key);
+
+    if (ht->old_entries) {
+        hash_table_migrate(ht, MIGRATE_STEP);
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t hash;
+
+    // Keys are matched against the caller's bytes, ignoring case.
+    if (!key_hash(ht->hash_fn, key, key_len, &hash)) {
+        perror("ERROR: hash_table_lookup (malloc)");
+        return NULL;
+    }
+
+#ifdef _DEBUG
+    printf("hash_table_lookup: computed_idx = %lu\tkey = %s\n",
+           (size_t)(hash & (ht->capacity - 1)), key);
+#endif
+
+    size_t idx = hash_table_find(ht, key, key_len, hash, 1);
+
+    return idx != SIZE_MAX ? entry_value(ht, &ht->entries[idx]) : NULL;
+}
+
+size_t hash_table_values(hash_table_t *ht, const char *key,
+                         ht_value_iter_t *iter) {
+    assert(ht && key && iter);
+
+    iter->next = NULL;
+    iter->rest = NULL;
+
+    if (ht->old_entries) {
+        hash_table_migrate(ht, MIGRATE_STEP);
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t hash;
+
+    if (!key_hash(ht->hash_fn, key, key_len, &hash)) {
+        perror("ERROR: hash_table_values (malloc)");
+        return 0;
+    }
+
+    size_t idx = hash_table_find(ht, key, key_len, hash, 1);
+    if (idx == SIZE_MAX) {
+        return 0;
+    }
+
+    const key_val_t *entry = &ht->entries[idx];
+    iter->next = entry->value;
+
+    if (!entry->values) {
+        return 1;
+    }
+
+    iter->rest = entry->values->head;
+    return entry->values->count;
+}
+
+const char *hash_table_value_next(ht_value_iter_t *iter) {
+    assert(iter);
+
+    const char *value = iter->next;
+
+    if (iter->rest) {
+        iter->next = iter->rest->value;
+        iter->rest = iter->rest->next;
+    } else {
+        iter->next = NULL;
+    }
+
+    return value;
+}
+
+int hash_table_delete(hash_table_t *ht, const char *key) {
+    assert(ht && key);
+
+    if (ht->old_entries) {
+        hash_table_migrate(ht, MIGRATE_STEP);
+    }
+
+    size_t key_len = strlen(key);
+    uint64_t hash;
+
+    // Keys are matched against the caller's bytes, ignoring case.
+    if (!key_hash(ht->hash_fn, key, key_len, &hash)) {
+        perror("ERROR: hash_table_delete (malloc)");
+        return 0;
+    }
+
+#ifdef _DEBUG
+    printf("hash_table_delete: computed_idx = %lu\tkey = %s\n",
+           (size_t)(hash & (ht->capacity - 1)), key);
+#endif
+
+    size_t idx = hash_table_find(ht, key, key_len, hash, 0);
+    if (idx == SIZE_MAX) {
+        return 0;
+    }
+
+    hash_table_erase(ht, idx);
+    return 1;
+}
+
+// Prints each value of `entry` after its first on a line of its own, as if
+// the key was repeated.
+static void print_later_values(const key_val_t *entry, const char *prefix,
+                               const char *sep) {
+    for (const ht_value_t *node = entry->values ? entry->values->head : NULL;
+         node; node = node->next) {
+        printf("%s\"%s\"%s\"%s\"\n", prefix, entry->key, sep, node->value);
+    }
+}
+
+void hash_table_debug_print(const hash_table_t *ht) {
+    assert(ht);
+
+    for (size_t i = 0; i < ht_slots(ht); ++i) {
+        key_val_t entry = ht->entries[i];
+#ifdef _DEBUG
+        if (entry.key && !entry.is_deleted) {
+            printf("[%zu]\t\"%s\" : \"%s\"\n", i, entry.key, entry.value);
+            print_later_values(&entry, "\t", " : ");
+        } else if (!entry.key && !entry.is_deleted) {
+            printf("[%zu]\t\"(null)\" : \"(null)\"\n", i);
+        } else {
+            printf("[%zu]\t\"(tombstone)\" : \"(tombstone)\"\n", i);
+        }
+#else
+        if (entry.key) {
+            printf("- \"%s\": \"%s\"\n", entry.key, entry.value);
+            print_later_values(&entry, "- ", ": ");
+        }
+#endif
+    }
+
+    // Entries not yet moved by an incremental resize.
+    for (size_t i = 0; ht->old_entries && i < ht->old_capacity; ++i) {
+        key_val_t entry = ht->old_entries[i];
+        if (entry.key) {
+            printf("- \"%s\": \"%s\"\n", entry.key, entry.value);
+            print_later_values(&entry, "- ", ": ");
+        }
+    }
+}
+
+// Calls `fn` with `ctx` for each entry of the given hash table, including
+// entries not yet moved by an incremental resize.
+static void hash_table_each(const hash_table_t *ht,
+                            void (*fn)(void *ctx, const key_val_t *entry),
+                            void *ctx) {
+    for (size_t i = 0; i < ht_slots(ht); ++i) {
+        if (ht->entries[i].key) {
+            fn(ctx, &ht->entries[i]);
+        }
+    }
+
+    for (size_t i = 0; ht->old_entries && i < ht->old_capacity; ++i) {
+        if (ht->old_entries[i].key) {
+            fn(ctx, &ht->old_entries[i]);
+        }
+    }
+}
+
+// Frozen table being built, with `off` the offset at which the next string
+// is written.
+typedef struct {
+    hash_table_frozen_t *ft;
+    size_t off;
+} frozen_builder_t;
+
+// Adds the bytes needed to store the key and value of `entry` to the total
+// pointed to by `ctx`.
+static void frozen_measure(void *ctx, const key_val_t *entry) {
+    *(size_t *)ctx += entry->key_len + entry_value_len(entry) + 2;
+}
+
+// Copies `entry` into the frozen table being built by `ctx`.
+static void frozen_copy(void *ctx, const key_val_t *entry) {
+    frozen_builder_t *builder = ctx;
+    hash_table_frozen_t *ft = builder->ft;
+    char *base = (char *)ft;
+
+    size_t mask = ft->capacity - 1;
+    size_t idx = entry->hash & mask;
+
+    // Linear probing, as the table is never modified afterwards.
+    while (ft->slots[idx].key_off) {
+        idx = (idx + 1) & mask;
+    }
+
+    frozen_slot_t *slot = &ft->slots[idx];
+    slot->hash = entry->hash;
+    slot->key_len = entry->key_len;
+    slot->key_off = (uint32_t)builder->off;
+    memcpy(base + builder->off, entry->key, entry->key_len + 1);
+    builder->off += entry->key_len + 1;
+
+    // Values of a key inserted more than once are stored joined.
+    slot->value_off = (uint32_t)builder->off;
+    entry_join(entry, base + builder->off);
+    builder->off += entry_value_len(entry) + 1;
+
+    ft->size++;
+}
+
+hash_table_frozen_t *hash_table_freeze(const hash_table_t *ht) {
+    assert(ht);
+
+    // At most half of the slots are used, keeping probing sequences short.
+    uint32_t capacity = 1;
+    while (capacity < (uint64_t)ht->size * 2) {
+        capacity *= 2;
+    }
+
+    size_t strings = 0;
+    hash_table_each(ht, frozen_measure, &strings);
+
+    size_t slots_end = sizeof(hash_table_frozen_t) +
+                       (size_t)capacity * sizeof(frozen_slot_t);
+
+    // Offsets of strings are stored in 32 bits.
+    if (strings > UINT32_MAX - slots_end) {
+        return NULL;
+    }
+
+    hash_table_frozen_t *ft = calloc(1, slots_end + strings);
+    if (!ft) {
+        perror("ERROR: hash_table_freeze (calloc)");
+        return NULL;
+    }
+
+    ft->hash_fn = ht->hash_fn;
+    ft->capacity = capacity;
+    ft->size = 0;
+
+    frozen_builder_t builder = {.ft = ft, .off = slots_end};
+    hash_table_each(ht, frozen_copy, &builder);
+
+    return ft;
+}
+
+const char *hash_table_frozen_lookup(const hash_table_frozen_t *ft,
+                                     const char *key) {
+    assert(ft && key);
+
+    size_t key_len = strlen(key);
+    uint64_t hash;
+
+    if (!key_hash(ft->hash_fn, key, key_len, &hash)) {
+        perror("ERROR: hash_table_frozen_lookup (malloc)");
+        return NULL;
+    }
+
+    const char *base = (const char *)ft;
+    size_t mask = ft->capacity - 1;
+
+    for (size_t idx = hash & mask; ft->slots[idx].key_off;
+         idx = (idx + 1) & mask) {
+        const frozen_slot_t *slot = &ft->slots[idx];
+
+        if (slot->hash == hash && slot->key_len == key_len &&
+            key_fold_equal(base + slot->key_off, key, key_len)) {
+            return base + slot->value_off;
+        }
+    }
+
+    return NULL;
+}
+
+void hash_table_frozen_free(hash_table_frozen_t *ft) {
+    free(ft);
 }
@@ -1,20 +1,267 @@
+/* Exposes Linux-specific socket options and `struct tcp_info`. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "listener.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 
-static int tcp_sock_fd = -1;
+// First file descriptor passed under the `LISTEN_FDS` convention.
+#define LISTEN_FDS_START 3
+
+// Seconds either side of a handoff waits for the other before giving up.
+#define HANDOFF_TIMEOUT 5
+
+// Listening sockets. Only the first is used unless `shards` was requested, in
+// which case socket N belongs to the SO_REUSEPORT group slot served by CPU
+// `tcp_shard_cpus[N]`.
+static int tcp_sock_fds[LISTENER_MAX_SHARDS];
+static size_t tcp_sock_count = 0;
+static int tcp_shard_cpus[LISTENER_MAX_SHARDS];
+
+// Self-pipe written once the sockets have been handed off to a successor. The
+// read end is never drained, so every thread blocked in accept is woken.
+static int wake_fds[2] = {-1, -1};
+
+// Options applied to the listening socket, kept to decide which counters to
+// update on accept.
+static listener_opts_t tcp_opts = {0};
+
+// Updated with relaxed atomics since connections may be accepted from multiple
+// threads.
+static listener_stats_t tcp_stats = {0};
+
+#define STAT_INC(field) __atomic_add_fetch(&tcp_stats.field, 1, __ATOMIC_RELAXED)
+#define STAT_LOAD(field) __atomic_load_n(&tcp_stats.field, __ATOMIC_RELAXED)
+
+// Apply the optional TCP_DEFER_ACCEPT and TCP_FASTOPEN options to `sockfd`.
+// Failures are reported but not fatal, as both are purely optimizations.
+static void apply_tcp_opts(int sockfd, const listener_opts_t *opts) {
+    // Only wake accept() once the client has sent data, so workers are never
+    // handed connections that are still idle after the handshake.
+    if (opts->defer_accept > 0 &&
+        setsockopt(sockfd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &opts->defer_accept,
+                   sizeof opts->defer_accept) == -1) {
+        perror("ERROR: setsockopt (TCP_DEFER_ACCEPT)");
+    }
+
+    // Allow clients with a valid Fast Open cookie to send the request in the
+    // SYN, saving a round trip on repeat connections.
+    if (opts->fastopen_qlen > 0 &&
+        setsockopt(sockfd, IPPROTO_TCP, TCP_FASTOPEN, &opts->fastopen_qlen,
+                   sizeof opts->fastopen_qlen) == -1) {
+        perror("ERROR: setsockopt (TCP_FASTOPEN)");
+    }
+}
+
+// Keep a copy of `opts`, including the CPU of each shard, as the caller's
+// array may not outlive the listener.
+static void set_opts(const listener_opts_t *opts) {
+    tcp_opts = *opts;
+    tcp_opts.shard_cpus = NULL;
+
+    assert(tcp_opts.shards <= LISTENER_MAX_SHARDS);
+
+    for (int shard = 0; shard < tcp_opts.shards; ++shard) {
+        tcp_shard_cpus[shard] = opts->shard_cpus ? opts->shard_cpus[shard]
+                                                 : shard;
+    }
+}
+
+// Update the option counters for a newly accepted `clientfd`. Only performs the
+// extra syscalls for options that were enabled on the listener.
+static void record_accept(size_t shard, int clientfd) {
+    STAT_INC(accepted);
+
+    if (tcp_opts.shards > 0) {
+        int cpu = -1;
+        socklen_t cpu_len = sizeof cpu;
+        if (getsockopt(clientfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &cpu_len) ==
+                0 &&
+            cpu == tcp_shard_cpus[shard]) {
+            STAT_INC(cpu_local);
+        }
+    }
+
+    if (tcp_opts.defer_accept > 0) {
+        int pending = 0;
+        if (ioctl(clientfd, FIONREAD, &pending) == 0 && pending > 0) {
+            STAT_INC(deferred);
+        }
+    }
+
+    if (tcp_opts.fastopen_qlen > 0) {
+        struct tcp_info info;
+        socklen_t info_len = sizeof info;
+        if (getsockopt(clientfd, IPPROTO_TCP, TCP_INFO, &info, &info_len) ==
+                0 &&
+            (info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+            STAT_INC(fastopen);
+        }
+    }
+}
+
+// Prepare adopted or newly bound listening sockets for accept: sockets are
+// made non-blocking, as a connection may be taken by another thread or by the
+// process the sockets are shared with between poll() and accept(). Returns (0)
+// on success, otherwise (-1).
+static int prepare_accept(void) {
+    for (size_t i = 0; i < tcp_sock_count; ++i) {
+        int flags = fcntl(tcp_sock_fds[i], F_GETFL);
+        if (flags == -1 ||
+            fcntl(tcp_sock_fds[i], F_SETFL, flags | O_NONBLOCK) == -1) {
+            perror("ERROR: fcntl");
+            return -1;
+        }
+    }
+
+    if (wake_fds[0] == -1 && pipe(wake_fds) == -1) {
+        perror("ERROR: pipe");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Take ownership of already listening sockets, in shard order. The number of
+// sockets must match the shards requested in `opts`. Returns (0) on success,
+// otherwise (-1).
+static int adopt_tcp(const int *fds, size_t count,
+                     const listener_opts_t *opts) {
+    size_t expected = opts && opts->shards > 0 ? (size_t)opts->shards : 1;
+    if (count != expected || count > LISTENER_MAX_SHARDS) {
+        fprintf(stderr, "ERROR: server: expected %zu sockets, got %zu.\n",
+                expected, count);
+        return -1;
+    }
+
+    if (opts) {
+        set_opts(opts);
+    }
+
+    memcpy(tcp_sock_fds, fds, count * sizeof *fds);
+    tcp_sock_count = count;
+
+    return prepare_accept();
+}
+
+// Attach a classic BPF program to the SO_REUSEPORT group of `sockfd` that
+// selects the listening socket serving the CPU which received the packet, so
+// the softirq and the worker accepting the connection share a core. Returns
+// (0) on success, otherwise (-1).
+static int attach_cpu_steering(int sockfd, uint32_t shards) {
+    struct sock_filter code[2 * LISTENER_MAX_SHARDS + 3];
+    size_t len = 0;
+
+    /* A = CPU the packet is being processed on. */
+    code[len++] = (struct sock_filter){BPF_LD | BPF_W | BPF_ABS, 0, 0,
+                                       (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)};
+
+    /* Return the shard serving A, if any, as the socket index within the
+     * group. */
+    for (uint32_t shard = 0; shard < shards; ++shard) {
+        code[len++] = (struct sock_filter){BPF_JMP | BPF_JEQ | BPF_K, 0, 1,
+                                           (uint32_t)tcp_shard_cpus[shard]};
+        code[len++] = (struct sock_filter){BPF_RET | BPF_K, 0, 0, shard};
+    }
+
+    /* Otherwise A = A % shards, keeping the index inside the group. */
+    code[len++] = (struct sock_filter){BPF_ALU | BPF_MOD | BPF_K, 0, 0, shards};
+    code[len++] = (struct sock_filter){BPF_RET | BPF_A, 0, 0, 0};
+
+    struct sock_fprog prog = {
+        .len = (unsigned short)len,
+        .filter = code,
+    };
+
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog,
+                   sizeof prog) == -1) {
+        perror("ERROR: setsockopt (SO_ATTACH_REUSEPORT_CBPF)");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Create a TCP socket for `ai`, bind it and start listening. When `cpu` is
+// non-negative the socket joins a SO_REUSEPORT group and is tagged with that
+// CPU. Returns the socket, otherwise (-1).
+static int bind_tcp(const struct addrinfo *ai, int backlog, int cpu) {
+    int sockfd, reuse = 1;
+
+    if ((sockfd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) ==
+        -1) {
+        perror("ERROR: socket");
+        return -1;
+    }
+
+    // Enable SO_REUSEADDR to allow the socket address to be reused after a
+    // restart.
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof reuse) ==
+        -1) {
+        perror("ERROR: setsockopt");
+        exit(1);
+    }
+
+    if (cpu >= 0) {
+        if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse,
+                       sizeof reuse) == -1) {
+            perror("ERROR: setsockopt (SO_REUSEPORT)");
+            exit(1);
+        }
+
+        // Hint for kernels that prefer a matching socket within the group
+        // when no steering program is attached.
+        if (setsockopt(sockfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+                       sizeof cpu) == -1) {
+            perror("ERROR: setsockopt (SO_INCOMING_CPU)");
+        }
+    }
+
+    if (bind(sockfd, ai->ai_addr, ai->ai_addrlen) == -1) {
+        perror("ERROR: bind");
+        close(sockfd);
+        return -1;
+    }
+
+    apply_tcp_opts(sockfd, &tcp_opts);
+
+    if (listen(sockfd, backlog) == -1) {
+        perror("ERROR: listen");
+        exit(1);
+    }
+
+    return sockfd;
+}
 
 // Initialize a TCP socket, bind it to the specified host and port, and listen
-// with the given backlog. Use NULL for host to bind to INADDR_ANY.
-static void listen_tcp(const char *host, const char *port, int backlog) {
+// with the given backlog. Use NULL for host to bind to INADDR_ANY, and NULL for
+// `opts` to leave all optional socket tuning disabled.
+static void listen_tcp(const char *host, const char *port, int backlog,
+                       const listener_opts_t *opts) {
     assert(port && backlog > 0);
 
-    int status, reuse = 1;
+    if (opts) {
+        set_opts(opts);
+    }
+
+    int status;
     struct addrinfo hints, *serverinfo, *curr_node;
 
     memset(&hints, 0, sizeof hints);
@@ -31,92 +278,512 @@ static void listen_tcp(const char *host, const char *port, int backlog) {
     // the first working socket.
     for (curr_node = serverinfo; curr_node != NULL;
          curr_node = curr_node->ai_next) {
-        if ((tcp_sock_fd = socket(curr_node->ai_family, curr_node->ai_socktype,
-                                  curr_node->ai_protocol)) == -1) {
-            perror("ERROR: socket");
-            continue;
+        if ((tcp_sock_fds[0] =
+                 bind_tcp(curr_node, backlog,
+                          tcp_opts.shards > 0 ? tcp_shard_cpus[0] : -1)) !=
+            -1) {
+            break;
         }
+    }
 
-        // Enable SO_REUSEADDR to allow the socket address to be reused after a
-        // restart.
-        if (setsockopt(tcp_sock_fd, SOL_SOCKET, SO_REUSEADDR, &reuse,
-                       sizeof reuse) == -1) {
-            perror("ERROR: setsockopt");
-            exit(1);
-        }
+    // Reached end of addrinfo list without finding a valid socket.
+    if (!curr_node) {
+        freeaddrinfo(serverinfo);
+        fprintf(stderr, "ERROR: server: failed to bind to socket.\n");
+        exit(1);
+    }
 
-        if (bind(tcp_sock_fd, curr_node->ai_addr, curr_node->ai_addrlen) ==
-            -1) {
-            perror("ERROR: bind");
-            continue;
+    tcp_sock_count = 1;
+
+    // Remaining sockets in the group bind to the same address, in shard order,
+    // since the group index returned by the steering program follows the
+    // order sockets were added.
+    for (int shard = 1; shard < tcp_opts.shards; ++shard) {
+        if ((tcp_sock_fds[shard] = bind_tcp(curr_node, backlog,
+                                            tcp_shard_cpus[shard])) == -1) {
+            freeaddrinfo(serverinfo);
+            fprintf(stderr, "ERROR: server: failed to bind shard %d.\n", shard);
+            exit(1);
         }
 
-        break;
+        tcp_sock_count++;
     }
 
     freeaddrinfo(serverinfo);
 
-    // Reached end of addrinfo list without finding a valid socket.
-    if (!curr_node) {
-        fprintf(stderr, "ERROR: server: failed to bind to socket.\n");
-        exit(1);
+    // Falling back to the kernel's default hashing across the group is still
+    // correct, only without the locality benefit.
+    if (tcp_opts.shards > 0) {
+        attach_cpu_steering(tcp_sock_fds[0], (uint32_t)tcp_opts.shards);
     }
 
-    if (listen(tcp_sock_fd, backlog) == -1) {
-        perror("ERROR: listen");
+    if (prepare_accept() == -1) {
         exit(1);
     }
 }
 
-// Wait for and accept incoming connections on the listening socket. Fills
-// `conn` with the peer's connection information. Returns (0) on successful
-// acceptance, otherwise (-1).
-static int accept_tcp(connection_t *conn) {
-    assert(conn);
+// Wait for and accept incoming connections on the listening socket of the
+// given shard. Fills `conn` with the peer's connection information. Returns (0)
+// on successful acceptance, (LISTENER_CLOSED) once the sockets were handed off,
+// otherwise (-1).
+static int accept_shard_tcp(size_t shard, connection_t *conn) {
+    assert(conn && shard < tcp_sock_count);
 
     // Large enough to hold either IPv4 (sockaddr_in) or IPv6 (sockaddr_in6)
     // address information.
     struct sockaddr_storage client_addr;
-    socklen_t sin_size = sizeof client_addr;
+    socklen_t sin_size;
+
+    struct pollfd pfds[2] = {
+        {.fd = tcp_sock_fds[shard], .events = POLLIN},
+        {.fd = wake_fds[0], .events = POLLIN},
+    };
+
+    int clientfd;
+    while (1) {
+        if (poll(pfds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("ERROR: poll");
+            return -1;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            return LISTENER_CLOSED;
+        }
+
+        sin_size = sizeof client_addr;
+        clientfd = accept(tcp_sock_fds[shard], (struct sockaddr *)&client_addr,
+                          &sin_size);
+        if (clientfd != -1) {
+            break;
+        }
+
+        // Connection was taken by another thread or process first.
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            continue;
+        }
 
-    int clientfd =
-        accept(tcp_sock_fd, (struct sockaddr *)&client_addr, &sin_size);
-    if (clientfd == -1) {
         perror("ERROR: accept");
         return -1;
     }
 
+    memset(conn->remote_bin, 0, sizeof conn->remote_bin);
+    conn->remote_family = client_addr.ss_family;
+
     switch (client_addr.ss_family) {
-        case AF_INET: /* IPv4 */
-            inet_ntop(AF_INET,
-                      &(((struct sockaddr_in *)(struct sockaddr *)&client_addr)
-                            ->sin_addr),
-                      conn->remote_addr,
+        case AF_INET: { /* IPv4 */
+            struct in_addr *addr =
+                &((struct sockaddr_in *)(struct sockaddr *)&client_addr)
+                     ->sin_addr;
+            inet_ntop(AF_INET, addr, conn->remote_addr,
                       sizeof conn->remote_addr / sizeof *conn->remote_addr);
+            memcpy(conn->remote_bin, addr, sizeof *addr);
             break;
-        case AF_INET6: /* IPv6 */
-            inet_ntop(AF_INET6,
-                      &(((struct sockaddr_in6 *)(struct sockaddr *)&client_addr)
-                            ->sin6_addr),
-                      conn->remote_addr,
+        }
+        case AF_INET6: { /* IPv6 */
+            struct in6_addr *addr =
+                &((struct sockaddr_in6 *)(struct sockaddr *)&client_addr)
+                     ->sin6_addr;
+            inet_ntop(AF_INET6, addr, conn->remote_addr,
                       sizeof conn->remote_addr / sizeof *conn->remote_addr);
+            memcpy(conn->remote_bin, addr, sizeof *addr);
             break;
+        }
     }
 
     conn->clientfd = clientfd;
 
+    record_accept(shard, clientfd);
+
     return 0;
 }
 
-// Close the server socket if open.
+// Accept on the first (or only) listening socket.
+static int accept_tcp(connection_t *conn) {
+    return accept_shard_tcp(0, conn);
+}
+
+// Copy a snapshot of the listener counters into `stats`.
+static void stats_tcp(listener_stats_t *stats) {
+    assert(stats);
+
+    stats->accepted = STAT_LOAD(accepted);
+    stats->deferred = STAT_LOAD(deferred);
+    stats->fastopen = STAT_LOAD(fastopen);
+    stats->cpu_local = STAT_LOAD(cpu_local);
+}
+
+// Check that `fd` is a listening stream socket. Returns (0) if so, otherwise
+// (-1).
+static int check_listening(int fd) {
+    int type, accepting;
+    socklen_t len = sizeof type;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == -1) {
+        fprintf(stderr, "ERROR: server: fd %d is not a socket.\n", fd);
+        return -1;
+    }
+
+    len = sizeof accepting;
+    if (type != SOCK_STREAM ||
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &accepting, &len) == -1 ||
+        !accepting) {
+        fprintf(stderr, "ERROR: server: fd %d is not listening.\n", fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Fill `addr` with the Unix socket address for `path`, after checking that
+// the directory holding it is only accessible by the current user, creating it
+// if missing. Otherwise any local user could bind the path first, or replace
+// the socket. Returns (0) on success, otherwise (-1).
+static int handoff_addr(struct sockaddr_un *addr, const char *path) {
+    size_t path_len = strlen(path);
+
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+
+    if (path_len >= sizeof addr->sun_path) {
+        fprintf(stderr, "ERROR: server: handoff path too long.\n");
+        return -1;
+    }
+
+    memcpy(addr->sun_path, path, path_len + 1);
+
+    // Directory of the socket, reusing `sun_path` as scratch space.
+    char *slash = strrchr(addr->sun_path, '/');
+    if (!slash || slash == addr->sun_path) {
+        fprintf(stderr, "ERROR: server: handoff path needs a directory.\n");
+        return -1;
+    }
+
+    *slash = '\0';
+
+    if (mkdir(addr->sun_path, 0700) == -1 && errno != EEXIST) {
+        perror("ERROR: mkdir");
+        return -1;
+    }
+
+    struct stat st;
+    if (lstat(addr->sun_path, &st) == -1 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        fprintf(stderr,
+                "ERROR: server: handoff directory \"%s\" must be owned by "
+                "this user with mode 0700.\n",
+                addr->sun_path);
+        return -1;
+    }
+
+    *slash = '/';
+    return 0;
+}
+
+// Prepare the control connection `fd` of a handoff: neither side waits on the
+// other for longer than (HANDOFF_TIMEOUT), and the peer must run as the same
+// user. Returns (0) on success, otherwise (-1).
+static int handoff_peer(int fd) {
+    struct timeval timeout = {.tv_sec = HANDOFF_TIMEOUT, .tv_usec = 0};
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout) ==
+            -1 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout) ==
+            -1) {
+        perror("ERROR: setsockopt (handoff timeout)");
+        return -1;
+    }
+
+    struct ucred cred;
+    socklen_t cred_len = sizeof cred;
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1) {
+        perror("ERROR: getsockopt (SO_PEERCRED)");
+        return -1;
+    }
+
+    if (cred.uid != geteuid()) {
+        fprintf(stderr, "ERROR: server: handoff peer runs as uid %u.\n",
+                (unsigned)cred.uid);
+        return -1;
+    }
+
+    return 0;
+}
+
+// Send all listening sockets to the successor connected on `peerfd` and wait
+// for it to acknowledge. Returns (0) on success, otherwise (-1).
+static int handoff_send(int peerfd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * LISTENER_MAX_SHARDS)];
+        struct cmsghdr align;
+    } control;
+    memset(&control, 0, sizeof control);
+
+    size_t fds_size = sizeof(int) * tcp_sock_count;
+
+    char tag = 'L';
+    struct iovec iov = {.iov_base = &tag, .iov_len = sizeof tag};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = CMSG_SPACE(fds_size),
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    memcpy(CMSG_DATA(cmsg), tcp_sock_fds, fds_size);
+
+    if (sendmsg(peerfd, &msg, 0) == -1) {
+        perror("ERROR: sendmsg");
+        return -1;
+    }
+
+    // The successor acknowledges once it owns the sockets and is about to
+    // accept; until then this process keeps accepting.
+    char ack;
+    if (recv(peerfd, &ack, sizeof ack, 0) != sizeof ack) {
+        fprintf(stderr, "ERROR: server: successor did not acknowledge.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// Serve the listening sockets to a successor process over the Unix socket at
+// `path`. Blocks until a successor has taken them over, then wakes all threads
+// waiting in accept so they can drain. Returns (0) on handoff, otherwise (-1).
+static int handoff_tcp(const char *path) {
+    assert(path && tcp_sock_count > 0);
+
+    struct sockaddr_un addr;
+    if (handoff_addr(&addr, path) == -1) {
+        return -1;
+    }
+
+    int srvfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (srvfd == -1) {
+        perror("ERROR: socket");
+        return -1;
+    }
+
+    // Remove the socket left behind by the previous generation. It is never
+    // removed on handoff, as the successor rebinds the same path.
+    if (unlink(path) == -1 && errno != ENOENT) {
+        perror("ERROR: unlink");
+        close(srvfd);
+        return -1;
+    }
+
+    if (bind(srvfd, (struct sockaddr *)&addr, sizeof addr) == -1 ||
+        listen(srvfd, 1) == -1) {
+        perror("ERROR: handoff");
+        close(srvfd);
+        return -1;
+    }
+
+    int status = -1;
+    while (status == -1) {
+        int peerfd = accept(srvfd, NULL, NULL);
+        if (peerfd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            perror("ERROR: accept");
+            break;
+        }
+
+        // Connections from other users are ignored, as are stalled ones.
+        if (handoff_peer(peerfd) == 0) {
+            status = handoff_send(peerfd);
+        }
+
+        close(peerfd);
+    }
+
+    close(srvfd);
+
+    if (status == 0 && write(wake_fds[1], "", 1) == -1) {
+        perror("ERROR: write");
+    }
+
+    return status;
+}
+
+// Receive listening sockets from a running predecessor over the Unix socket at
+// `path` and adopt them. Returns (0) on success, otherwise (-1) if there is no
+// predecessor or the handoff failed.
+static int takeover_tcp(const char *path, const listener_opts_t *opts) {
+    assert(path);
+
+    struct sockaddr_un addr;
+    if (handoff_addr(&addr, path) == -1) {
+        return -1;
+    }
+
+    int ctlfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (ctlfd == -1) {
+        perror("ERROR: socket");
+        return -1;
+    }
+
+    // No predecessor is running, caller should bind its own sockets.
+    if (connect(ctlfd, (struct sockaddr *)&addr, sizeof addr) == -1) {
+        close(ctlfd);
+        return -1;
+    }
+
+    if (handoff_peer(ctlfd) == -1) {
+        close(ctlfd);
+        return -1;
+    }
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * LISTENER_MAX_SHARDS)];
+        struct cmsghdr align;
+    } control;
+
+    char tag;
+    struct iovec iov = {.iov_base = &tag, .iov_len = sizeof tag};
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof control.buf,
+    };
+
+    // Received descriptors must not leak into processes we execute.
+    if (recvmsg(ctlfd, &msg, MSG_CMSG_CLOEXEC) != sizeof tag) {
+        perror("ERROR: recvmsg");
+        close(ctlfd);
+        return -1;
+    }
+
+    int fds[LISTENER_MAX_SHARDS];
+    size_t count = 0;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS) {
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), count * sizeof(int));
+    }
+
+    if (count == 0 || (msg.msg_flags & MSG_CTRUNC)) {
+        fprintf(stderr, "ERROR: server: handoff carried no sockets.\n");
+        for (size_t i = 0; i < count; ++i) {
+            close(fds[i]);
+        }
+        close(ctlfd);
+        return -1;
+    }
+
+    int status = 0;
+    for (size_t i = 0; i < count && status == 0; ++i) {
+        status = check_listening(fds[i]);
+    }
+
+    if (status == -1 || adopt_tcp(fds, count, opts) == -1) {
+        for (size_t i = 0; i < count; ++i) {
+            close(fds[i]);
+        }
+        close(ctlfd);
+        return -1;
+    }
+
+    if (send(ctlfd, &tag, sizeof tag, 0) != sizeof tag) {
+        perror("ERROR: send");
+    }
+
+    close(ctlfd);
+    return 0;
+}
+
+// Adopt sockets bound and listened on by a supervisor. If `fd` is
+// (LISTENER_FDS_FROM_ENV), sockets are taken from the `LISTEN_FDS` and
+// `LISTEN_PID` environment variables, starting at fd 3, and both variables are
+// unset so they are not passed on to children. Otherwise `fd` itself is
+// adopted. Returns (0) on success, otherwise (-1).
+static int inherit_tcp(int fd, const listener_opts_t *opts) {
+    int fds[LISTENER_MAX_SHARDS];
+    size_t count = 0;
+
+    if (fd != LISTENER_FDS_FROM_ENV) {
+        fds[count++] = fd;
+    } else {
+        const char *listen_pid = getenv("LISTEN_PID");
+        const char *listen_fds = getenv("LISTEN_FDS");
+        if (!listen_pid || !listen_fds) {
+            return -1;
+        }
+
+        char *endptr = NULL;
+        long pid = strtol(listen_pid, &endptr, 10);
+
+        // Variables were meant for another process (e.g. our parent).
+        if (*endptr != '\0' || pid != (long)getpid()) {
+            return -1;
+        }
+
+        long nfds = strtol(listen_fds, &endptr, 10);
+        if (*endptr != '\0' || nfds <= 0 || nfds > LISTENER_MAX_SHARDS) {
+            fprintf(stderr, "ERROR: server: invalid LISTEN_FDS \"%s\".\n",
+                    listen_fds);
+            return -1;
+        }
+
+        for (int i = 0; i < (int)nfds; ++i) {
+            fds[count++] = LISTEN_FDS_START + i;
+        }
+
+        unsetenv("LISTEN_PID");
+        unsetenv("LISTEN_FDS");
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (check_listening(fds[i]) == -1) {
+            return -1;
+        }
+
+        // Inherited descriptors must not leak into processes we execute.
+        if (fcntl(fds[i], F_SETFD, FD_CLOEXEC) == -1) {
+            perror("ERROR: fcntl");
+            return -1;
+        }
+    }
+
+    return adopt_tcp(fds, count, opts);
+}
+
+// Close all open server sockets.
 static void close_tcp(void) {
-    if (tcp_sock_fd != -1) {
-        close(tcp_sock_fd);
+    for (size_t i = 0; i < tcp_sock_count; ++i) {
+        close(tcp_sock_fds[i]);
+        tcp_sock_fds[i] = -1;
+    }
+
+    tcp_sock_count = 0;
+
+    for (size_t i = 0; i < 2; ++i) {
+        if (wake_fds[i] != -1) {
+            close(wake_fds[i]);
+            wake_fds[i] = -1;
+        }
     }
 }
 
 listener_t tcp_listener = {
     .listen = listen_tcp,
     .accept = accept_tcp,
+    .accept_shard = accept_shard_tcp,
+    .stats = stats_tcp,
+    .handoff = handoff_tcp,
+    .takeover = takeover_tcp,
+    .inherit = inherit_tcp,
     .close = close_tcp,
 };
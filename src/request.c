@@ -1,10 +1,20 @@
 #include "request.h"
 
 #include <assert.h>
-#include <errno.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "uri.h"
+
+// Longest chunk extension or trailer field line accepted in a chunked body.
+#define CHUNK_LINE_MAX 4096
+
+// Size of the buffer embedded in the parser for the request line and headers.
+#define HEAD_INLINE_SIZE 512
+
 // State machine approach for incremental parsing of the request.
 typedef enum {
     PARSER_RL = 0, /* State for parsing the request line. */
@@ -12,19 +22,202 @@ typedef enum {
     PARSER_B,      /* State for parsing the body. */
 } parser_state_t;
 
+// States of the chunked transfer coding decoder, resumable at any byte.
+typedef enum {
+    CHUNK_SIZE = 0,     /* Hex digits of the chunk size. */
+    CHUNK_EXT,          /* Chunk extensions, skipped up to the CR. */
+    CHUNK_SIZE_LF,      /* LF ending the chunk size line. */
+    CHUNK_DATA,         /* Chunk data. */
+    CHUNK_DATA_CR,      /* CR following chunk data. */
+    CHUNK_DATA_LF,      /* LF following chunk data. */
+    CHUNK_TRAILER,      /* Start of a trailer field line or the final CRLF. */
+    CHUNK_TRAILER_LINE, /* Trailer field line, skipped up to the CR. */
+    CHUNK_TRAILER_LF,   /* LF ending a trailer field line. */
+    CHUNK_END_LF,       /* LF ending the chunked body. */
+} chunk_state_t;
+
 typedef struct {
-    char buf[BODY_SIZE]; /* Buffer for accumulating parts of the request. */
-    size_t bytes_read;   /* Number of bytes read so far. */
+    chunk_state_t state;
+    size_t remaining;  /* Bytes of the current chunk left to deliver. */
+    size_t digits;     /* Hex digits read for the current chunk size. */
+    size_t line_bytes; /* Bytes of the current extension or trailer line. */
+} chunk_decoder_t;
+
+typedef struct {
+    char *buf;            /* Buffer for accumulating the request line and
+                             headers, either `inline_buf` or a segment. */
+    size_t buf_size;      /* Capacity of `buf`, with the null-terminator. */
+    size_t bytes_read;    /* Number of bytes read so far. */
+    size_t head_bytes;    /* Bytes of the request line and headers consumed. */
+    size_t header_count;  /* Number of field lines parsed. */
+    size_t body_read;     /* Number of body bytes delivered so far. */
+    int body_started;     /* Set once the body framing has been determined. */
+    int body_chunked;     /* Set when the body uses chunked transfer coding. */
+    chunk_decoder_t chunk;       /* State of the chunked decoder. */
     parser_state_t parser_state; /* Current state of the parser. */
+    char inline_buf[HEAD_INLINE_SIZE]; /* Covers most requests without
+                                          taking a segment. */
 } parser_t;
 
 // Must be thread-local if shared globally, using GCC-specific extension.
 __thread parser_t parser = {0};
 
+// Size classes of the segments `parser.buf` grows into once `inline_buf` is
+// full. Each thread keeps one free segment per class, so repeated large
+// requests do not go back to the allocator.
+static const size_t segment_sizes[] = {4 * 1024, 16 * 1024, 64 * 1024};
+
+#define SEGMENT_CLASSES (sizeof segment_sizes / sizeof *segment_sizes)
+
+static __thread char *segment_pool[SEGMENT_CLASSES];
+
+// Return the segment used by `parser.buf` to the pool, freeing it if its class
+// is already cached or it was sized outside of any class.
+static void segment_release(void) {
+    if (!parser.buf || parser.buf == parser.inline_buf) {
+        return;
+    }
+
+    for (size_t i = 0; i < SEGMENT_CLASSES; ++i) {
+        if (parser.buf_size == segment_sizes[i] && !segment_pool[i]) {
+            segment_pool[i] = parser.buf;
+            return;
+        }
+    }
+
+    free(parser.buf);
+}
+
+// Ensure `parser.buf` can hold `size` bytes and the null-terminator, moving
+// its contents to the smallest segment large enough. Returns (1) on success,
+// otherwise (0).
+static int parser_reserve(size_t size) {
+    if (!parser.buf) {
+        parser.buf = parser.inline_buf;
+        parser.buf_size = sizeof parser.inline_buf;
+    }
+
+    if (size < parser.buf_size) {
+        return 1;
+    }
+
+    char *segment = NULL;
+    size_t segment_size = size + 1;
+
+    for (size_t i = 0; i < SEGMENT_CLASSES; ++i) {
+        if (segment_size <= segment_sizes[i]) {
+            segment_size = segment_sizes[i];
+            segment = segment_pool[i];
+            segment_pool[i] = NULL;
+            break;
+        }
+    }
+
+    // Larger than any class only when a single chunk carries more than the
+    // largest segment, so such segments are not pooled.
+    if (!segment && !(segment = malloc(segment_size))) {
+        perror("ERROR: parser_reserve (malloc)");
+        return 0;
+    }
+
+    memcpy(segment, parser.buf, parser.bytes_read + 1);
+    segment_release();
+
+    parser.buf = segment;
+    parser.buf_size = segment_size;
+    return 1;
+}
+
 // Reset the parser to its default state after parsing since the state lasts
 // for the lifetime of the thread using it.
 static void parser_reset(void) {
-    memset(&parser, 0, sizeof parser);
+    segment_release();
+
+    // Contents of `inline_buf` are never read past `bytes_read`, so only the
+    // state preceding it is cleared.
+    memset(&parser, 0, offsetof(parser_t, inline_buf));
+}
+
+const char *known_header_to_str[] = {
+    "host",         "connection",        "content-length",
+    "content-type", "transfer-encoding", "expect",
+    "accept",       "accept-encoding",   "user-agent",
+};
+
+// Perfect hash of the known headers over the field-name length and its first
+// and last characters, lowercased.
+#define KNOWN_HEADER_HASH(len, first, last) \
+    (((len) + (size_t)(first) + (size_t)(last) * 7) & 15)
+
+// Slots of the perfect hash hold the known header plus one, (0) if unused.
+static const uint8_t known_header_slots[16] = {
+    [1] = HEADER_ACCEPT_ENCODING + 1,   [2] = HEADER_CONTENT_TYPE + 1,
+    [3] = HEADER_ACCEPT + 1,            [6] = HEADER_TRANSFER_ENCODING + 1,
+    [7] = HEADER_EXPECT + 1,            [8] = HEADER_HOST + 1,
+    [9] = HEADER_CONTENT_LENGTH + 1,    [11] = HEADER_USER_AGENT + 1,
+    [15] = HEADER_CONNECTION + 1,
+};
+
+// Returns the known header named by the `len` bytes of `name`, ignoring case,
+// otherwise (KNOWN_HEADERS).
+static known_header_t known_header_lookup(const char *name, size_t len) {
+    if (len == 0) {
+        return KNOWN_HEADERS;
+    }
+
+    uint8_t slot = known_header_slots[KNOWN_HEADER_HASH(
+        len, tolower((unsigned char)name[0]),
+        tolower((unsigned char)name[len - 1]))];
+    if (slot == 0) {
+        return KNOWN_HEADERS;
+    }
+
+    known_header_t header = (known_header_t)(slot - 1);
+
+    // Hash only narrows the candidates down to one, so the name itself still
+    // has to match.
+    const char *known = known_header_to_str[header];
+    for (size_t i = 0; i < len; ++i) {
+        if (tolower((unsigned char)name[i]) != known[i]) {
+            return KNOWN_HEADERS;
+        }
+    }
+
+    return known[len] == '\0' ? header : KNOWN_HEADERS;
+}
+
+// Store `value` of `value_len` bytes as the known `header` of `req`. Duplicates
+// are appended in a comma-separated list, as with the header table. Returns
+// (PARSE_OK) on success, otherwise (PARSE_INVALID).
+static int known_header_set(request_t *req, known_header_t header,
+                            const char *value, size_t value_len) {
+    const char *prev = req->known_headers[header];
+    size_t prev_len = prev ? strlen(prev) + 2 : 0;
+
+    // Multiple `Host` headers make the target authority ambiguous.
+    if (prev && header == HEADER_HOST) {
+        return PARSE_INVALID;
+    }
+
+    if (prev_len + value_len >=
+        HEADER_VALUES_SIZE - req->header_values_len) {
+        return PARSE_INVALID;
+    }
+
+    // Joined value is written after every stored value, so the space of the
+    // previous value is not reused.
+    char *dest = req->header_values + req->header_values_len;
+    if (prev) {
+        memcpy(dest, prev, prev_len - 2);
+        memcpy(dest + prev_len - 2, ", ", 2);
+    }
+
+    memcpy(dest + prev_len, value, value_len);
+    dest[prev_len + value_len] = '\0';
+
+    req->known_headers[header] = dest;
+    req->header_values_len += prev_len + value_len + 1;
+    return PARSE_OK;
 }
 
 // Lookup tables for efficient token validation. Each "bit" represents whether
@@ -59,78 +252,447 @@ const char *method_to_str[] = {
     "PUT",     /* PUT */
     "DELETE",  /* DELETE */
     "OPTIONS", /* OPTIONS */
+    "PATCH",   /* PATCH */
+    "CONNECT", /* CONNECT */
+    "TRACE",   /* TRACE */
     "UNKNOWN"  /* UNKNOWN_METHOD */
 };
 
-static method_t str_to_method(const char *method_str) {
-    if (strcmp(method_str, "GET") == 0) return GET;
-    if (strcmp(method_str, "HEAD") == 0) return HEAD;
-    if (strcmp(method_str, "POST") == 0) return POST;
-    if (strcmp(method_str, "PUT") == 0) return PUT;
-    if (strcmp(method_str, "DELETE") == 0) return DELETE;
-    if (strcmp(method_str, "OPTIONS") == 0) return OPTIONS;
+// Packs up to 8 characters into the value `load_word` returns for them, so
+// tokens can be matched with a single integer compare.
+#define WORD(a, b, c, d, e, f, g, h)                                       \
+    ((uint64_t)(a) | (uint64_t)(b) << 8 | (uint64_t)(c) << 16 |            \
+     (uint64_t)(d) << 24 | (uint64_t)(e) << 32 | (uint64_t)(f) << 40 |     \
+     (uint64_t)(g) << 48 | (uint64_t)(h) << 56)
+
+// Load 8 bytes from `data`, with the first byte in the least significant
+// position regardless of the byte order of the host.
+static inline uint64_t load_word(const char *data) {
+    uint64_t word;
+    memcpy(&word, data, sizeof word);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+
+    return word;
+}
+
+// Match the method token of `len` bytes at the start of `line`, which must
+// have at least 8 readable bytes.
+static method_t str_to_method(const char *line, size_t len) {
+    if (len == 0 || len > METHOD_SIZE) {
+        return UNKNOWN_METHOD;
+    }
+
+    // Bytes following the token are masked off, leaving zeros that also
+    // match the padding of the constants below.
+    uint64_t word = load_word(line) & ((UINT64_C(1) << (len * 8)) - 1);
+
+    switch (word) {
+        case WORD('G', 'E', 'T', 0, 0, 0, 0, 0): return GET;
+        case WORD('H', 'E', 'A', 'D', 0, 0, 0, 0): return HEAD;
+        case WORD('P', 'O', 'S', 'T', 0, 0, 0, 0): return POST;
+        case WORD('P', 'U', 'T', 0, 0, 0, 0, 0): return PUT;
+        case WORD('D', 'E', 'L', 'E', 'T', 'E', 0, 0): return DELETE;
+        case WORD('O', 'P', 'T', 'I', 'O', 'N', 'S', 0): return OPTIONS;
+        case WORD('P', 'A', 'T', 'C', 'H', 0, 0, 0): return PATCH;
+        case WORD('C', 'O', 'N', 'N', 'E', 'C', 'T', 0): return CONNECT;
+        case WORD('T', 'R', 'A', 'C', 'E', 0, 0, 0): return TRACE;
+        default: return UNKNOWN_METHOD;
+    }
+}
+
+// Deliver `len` bytes of the body, either to the body callback of `req` or
+// into `req->body`. Returns (PARSE_OK) on success, otherwise the status
+// returned by the callback.
+static int body_deliver(request_t *req, const char *data, size_t len) {
+    if (len == 0) {
+        return PARSE_OK;
+    }
+
+    if (req->body_cb) {
+        return req->body_cb(req->body_ctx, data, len);
+    }
+
+    memcpy(req->body + parser.body_read, data, len);
+    return PARSE_OK;
+}
+
+// Compare `str` against lowercase `lower`, ignoring ASCII case. Returns (1) if
+// equal, otherwise (0).
+static int str_eq_lower(const char *str, const char *lower) {
+    while (*str && tolower((unsigned char)*str) == *lower) {
+        str++;
+        lower++;
+    }
 
-    return UNKNOWN_METHOD;
+    return *str == *lower;
 }
 
-static int request_body_parse(request_t *req, size_t chunk_len) {
-    if (req->body_len == 0) {
-        char *content_length;
-        // Assuming that a body is only present when `Content-Length`
-        // header is present.
-        if ((content_length =
-                 hash_table_lookup(req->headers, "content-length")) == NULL) {
-            // Nothing left to parse.
-            return PARSE_OK;
-        }
-
-        // Save and restore errno.
-        int saved_errno = errno;
-
-        char *endptr = NULL;
-        long body_len = strtol(content_length, &endptr, 10);
-        // Underflow/overflow occurred, no digits found, or additional
-        // characters are remaining.
-        if (errno == ERANGE || content_length == endptr ||
-            (errno == 0 && *endptr != 0)) {
-            if (errno != 0) {
-                perror("ERROR: request_parse (strtol)");
+// Largest body accepted for `req`, (0) for no limit. Buffered bodies need room
+// for the null-terminator.
+static size_t body_max(const request_t *req) {
+    return req->body_cb ? req->body_limit : BODY_SIZE - 1;
+}
+
+// Parse the `Content-Length` field-value `value` into `len`. Only digits are
+// accepted, so signs, whitespace within a value and overflowing lengths are
+// rejected. A list of identical lengths, from repeated fields or within one
+// field, counts as a single one as RFC 9110 allows. Returns (PARSE_OK) on
+// success, (PARSE_TOO_LARGE) for lengths above `max` unless it is (0),
+// otherwise (PARSE_INVALID).
+static int content_length_parse(const char *value, size_t max, size_t *len) {
+    size_t result = 0;
+    int found = 0;
+
+    while (*value != '\0') {
+        // Whitespace around list members, and empty members, are ignored.
+        if (*value == ' ' || *value == '\t' || *value == ',') {
+            value++;
+            continue;
+        }
+
+        size_t n = 0;
+        const char *digits = value;
+        while (*value >= '0' && *value <= '9') {
+            size_t digit = (size_t)(*value++ - '0');
+            if (n > (SIZE_MAX - digit) / 10) {
+                return PARSE_INVALID;
             }
+
+            n = n * 10 + digit;
+        }
+
+        if (value == digits || (found && n != result)) {
             return PARSE_INVALID;
         }
 
-        errno = saved_errno;
+        if (max > 0 && n > max) {
+            return PARSE_TOO_LARGE;
+        }
+
+        // Members must be separated by a comma.
+        while (*value == ' ' || *value == '\t') {
+            value++;
+        }
 
-        if (body_len < 0 || body_len > BODY_SIZE) {
+        if (*value != ',' && *value != '\0') {
             return PARSE_INVALID;
         }
 
-        req->body_len = (size_t)body_len;
+        result = n;
+        found = 1;
     }
 
-    // Content length of 0, but bytes are being read, so body is left empty.
-    if (req->body_len == 0 && chunk_len > 0) {
+    if (!found) {
+        return PARSE_INVALID;
+    }
+
+    *len = result;
+    return PARSE_OK;
+}
+
+// Determine the length of the body from the headers of `req`. Returns
+// (PARSE_OK) on success, otherwise (PARSE_TOO_LARGE) or (PARSE_INVALID).
+static int request_body_length(request_t *req) {
+    const char *transfer_encoding =
+        req->known_headers[HEADER_TRANSFER_ENCODING];
+    const char *content_length = req->known_headers[HEADER_CONTENT_LENGTH];
+
+    if (transfer_encoding) {
+        // Only the chunked coding is supported, and a message carrying both
+        // framings is rejected since the two could be used to smuggle
+        // requests past intermediaries.
+        if (!str_eq_lower(transfer_encoding, "chunked") || content_length) {
+            return PARSE_INVALID;
+        }
+
+        parser.body_chunked = 1;
+        req->body_len = 0;
         return PARSE_OK;
     }
 
-    // There is more of the body to parse.
-    if (parser.bytes_read < req->body_len && chunk_len > 0) {
-        return PARSE_INCOMPLETE;
+    // Assuming that a body is only present when `Content-Length` or
+    // `Transfer-Encoding` header is present.
+    if (!content_length) {
+        req->body_len = 0;
+        return PARSE_OK;
+    }
+
+    return content_length_parse(content_length, body_max(req),
+                                &req->body_len);
+}
+
+// Decode the next `len` bytes of a chunked body. The decoder state is kept in
+// `parser.chunk`, so input may be split at any byte. Chunk data is delivered
+// directly from `data` without copying. Trailer fields are validated for
+// framing only and discarded. Returns (PARSE_OK) once the last chunk and
+// trailers are complete, (PARSE_INCOMPLETE) if more data is required,
+// otherwise (PARSE_INVALID) or the status of the body callback.
+static int chunked_decode(request_t *req, const char *data, size_t len) {
+    chunk_decoder_t *dec = &parser.chunk;
+    const char *end = data + len;
+    int status;
+
+    while (data < end) {
+        switch (dec->state) {
+            case CHUNK_SIZE: {
+                int digit = uri_hex_value(*data);
+                if (digit != -1) {
+                    // Reject sizes that would overflow before shifting in the
+                    // next digit.
+                    if (dec->remaining > (SIZE_MAX >> 4)) {
+                        return PARSE_INVALID;
+                    }
+
+                    dec->remaining = (dec->remaining << 4) | (size_t)digit;
+                    dec->digits++;
+                    data++;
+                    break;
+                }
+
+                if (dec->digits == 0) {
+                    return PARSE_INVALID;
+                }
+
+                if (*data == ';' || *data == ' ' || *data == '\t') {
+                    dec->state = CHUNK_EXT;
+                    dec->line_bytes = 0;
+                } else if (*data == '\r') {
+                    dec->state = CHUNK_SIZE_LF;
+                } else {
+                    return PARSE_INVALID;
+                }
+
+                data++;
+                break;
+            }
+            case CHUNK_EXT: {
+                // Chunk extensions carry no meaning here and are skipped, but
+                // their length is bounded.
+                if (*data == '\r') {
+                    dec->state = CHUNK_SIZE_LF;
+                } else if (*data == '\n' ||
+                           ++dec->line_bytes > CHUNK_LINE_MAX) {
+                    return PARSE_INVALID;
+                }
+
+                data++;
+                break;
+            }
+            case CHUNK_SIZE_LF: {
+                if (*data++ != '\n') {
+                    return PARSE_INVALID;
+                }
+
+                // Last chunk is followed by the trailer section.
+                if (dec->remaining == 0) {
+                    dec->state = CHUNK_TRAILER;
+                    dec->line_bytes = 0;
+                    break;
+                }
+
+                size_t max = body_max(req);
+                if (max > 0 && dec->remaining > max - parser.body_read) {
+                    return PARSE_TOO_LARGE;
+                }
+
+                dec->state = CHUNK_DATA;
+                break;
+            }
+            case CHUNK_DATA: {
+                size_t avail = (size_t)(end - data);
+                size_t take = avail < dec->remaining ? avail : dec->remaining;
+
+                if ((status = body_deliver(req, data, take)) != PARSE_OK) {
+                    return status;
+                }
+
+                parser.body_read += take;
+                dec->remaining -= take;
+                data += take;
+
+                if (dec->remaining == 0) {
+                    dec->state = CHUNK_DATA_CR;
+                }
+                break;
+            }
+            case CHUNK_DATA_CR: {
+                if (*data++ != '\r') {
+                    return PARSE_INVALID;
+                }
+
+                dec->state = CHUNK_DATA_LF;
+                break;
+            }
+            case CHUNK_DATA_LF: {
+                if (*data++ != '\n') {
+                    return PARSE_INVALID;
+                }
+
+                dec->state = CHUNK_SIZE;
+                dec->digits = 0;
+                break;
+            }
+            case CHUNK_TRAILER: {
+                if (*data == '\r') {
+                    dec->state = CHUNK_END_LF;
+                } else if ((unsigned char)*data < 128 &&
+                           tchars_name_lookup_table[(unsigned char)*data]) {
+                    dec->state = CHUNK_TRAILER_LINE;
+                } else {
+                    return PARSE_INVALID;
+                }
+
+                data++;
+                break;
+            }
+            case CHUNK_TRAILER_LINE: {
+                if (*data == '\r') {
+                    dec->state = CHUNK_TRAILER_LF;
+                } else if (*data == '\n' ||
+                           ++dec->line_bytes > CHUNK_LINE_MAX) {
+                    return PARSE_INVALID;
+                }
+
+                data++;
+                break;
+            }
+            case CHUNK_TRAILER_LF: {
+                if (*data++ != '\n') {
+                    return PARSE_INVALID;
+                }
+
+                dec->state = CHUNK_TRAILER;
+                break;
+            }
+            case CHUNK_END_LF: {
+                if (*data != '\n') {
+                    return PARSE_INVALID;
+                }
+
+                // Any bytes after the chunked body are ignored.
+                req->body_len = parser.body_read;
+                if (!req->body_cb) {
+                    req->body[req->body_len] = '\0';
+                }
+                return PARSE_OK;
+            }
+        }
+    }
+
+    return PARSE_INCOMPLETE;
+}
+
+// Determine the framing of the body once the head of `req` is complete, with
+// `buffered` bytes of the body already received. Returns (PARSE_OK) if there
+// is no body, (PARSE_INCOMPLETE) if it is still to be parsed, (PARSE_CONTINUE)
+// if the client waits for an interim response before sending it, otherwise
+// (PARSE_EXPECTATION_FAILED), (PARSE_TOO_LARGE) or (PARSE_INVALID).
+static int request_body_begin(request_t *req, size_t buffered) {
+    const char *expect = req->known_headers[HEADER_EXPECT];
+    int status;
+
+    parser.parser_state = PARSER_B;
+
+    // `100-continue` is the only expectation defined by RFC 9110.
+    if (expect && !str_eq_lower(expect, "100-continue")) {
+        return PARSE_EXPECTATION_FAILED;
+    }
+
+    if ((status = request_body_length(req)) != PARSE_OK) {
+        return status;
+    }
+
+    parser.body_started = 1;
+
+    // Framing headers tell whether the body is complete without waiting for
+    // more data.
+    if (!parser.body_chunked && req->body_len == 0) {
+        if (!req->body_cb) {
+            req->body[0] = '\0';
+        }
+        return PARSE_OK;
+    }
+
+    // No interim response is needed once the client started sending the body
+    // without waiting for it.
+    if (expect && buffered == 0) {
+        return PARSE_CONTINUE;
+    }
+
+    return PARSE_INCOMPLETE;
+}
+
+// Parse the body of `req` from any bytes left over in `parser.buf` after the
+// headers, followed by `chunk`. Body data is never copied into `parser.buf`.
+static int request_body_parse(request_t *req, const char *chunk,
+                              size_t chunk_len) {
+    int status;
+
+    if (parser.body_chunked) {
+        if (parser.bytes_read > 0) {
+            status = chunked_decode(req, parser.buf, parser.bytes_read);
+            parser.bytes_read = 0;
+
+            if (status != PARSE_INCOMPLETE) {
+                return status;
+            }
+        }
+
+        status = chunked_decode(req, chunk, chunk_len);
+
+        // Empty chunk indicates no more new data is coming in, so body
+        // should be ready at this point.
+        if (status == PARSE_INCOMPLETE && chunk_len == 0) {
+            return PARSE_INVALID;
+        }
+
+        return status;
+    }
+
+    if (parser.body_read == 0 && parser.bytes_read > 0) {
+        // Body will be truncated if longer than specified content length.
+        size_t buffered = parser.bytes_read;
+        if (buffered > req->body_len) {
+            buffered = req->body_len;
+        }
+
+        if ((status = body_deliver(req, parser.buf, buffered)) != PARSE_OK) {
+            return status;
+        }
+
+        parser.body_read = buffered;
+        parser.bytes_read = 0;
+    }
+
+    size_t remaining = req->body_len - parser.body_read;
+    if (chunk_len > remaining) {
+        chunk_len = remaining;
+    }
+
+    if ((status = body_deliver(req, chunk, chunk_len)) != PARSE_OK) {
+        return status;
+    }
+
+    parser.body_read += chunk_len;
+
+    if (parser.body_read == req->body_len) {
+        if (!req->body_cb) {
+            req->body[req->body_len] = '\0';
+        }
+        return PARSE_OK;
     }
 
     // Empty chunk indicates no more new data is coming in, so body
     // should be ready at this point.
-    if (parser.bytes_read < req->body_len && chunk_len == 0) {
+    if (chunk_len == 0) {
         return PARSE_INVALID;
     }
 
-    // Body will be truncated if longer than specified content length.
-    if (parser.bytes_read >= req->body_len) {
-        memcpy(req->body, parser.buf, req->body_len);
-        req->body[req->body_len] = '\0';
-    }
-
-    return PARSE_OK;
+    // There is more of the body to parse.
+    return PARSE_INCOMPLETE;
 }
 
 // Parse the given line, populating the headers of `req`.
@@ -195,6 +757,12 @@ static int request_header_parse(request_t *req, char *line, size_t line_len) {
         return PARSE_INVALID;
     }
 
+    known_header_t header = known_header_lookup(line, field_name_len);
+    if (header != KNOWN_HEADERS) {
+        return known_header_set(req, header, field_name_end,
+                                field_value_len + 1);
+    }
+
     line[field_name_len] = '\0';
 
     // `line` contains field-name and `field_name_end` contains field-value.
@@ -207,6 +775,12 @@ static int request_header_parse(request_t *req, char *line, size_t line_len) {
 
 // Parse the given line, populating the request-line of `req`.
 static int request_line_parse(request_t *req, char *line, size_t line_len) {
+    // Shortest valid request line is 16 bytes ("GET / HTTP/1.1\r\n"), which
+    // also keeps the 8 byte loads of the method and version in bounds.
+    if (line_len < 16) {
+        return PARSE_INVALID;
+    }
+
     char *method_end = line;
     while (line_len-- > 0 && *method_end != ' ') {
         method_end++;
@@ -222,8 +796,7 @@ static int request_line_parse(request_t *req, char *line, size_t line_len) {
     }
 
     method_t method;
-    line[method_len] = '\0';
-    if ((method = str_to_method(line)) == UNKNOWN_METHOD) {
+    if ((method = str_to_method(line, method_len)) == UNKNOWN_METHOD) {
         return PARSE_INVALID;
     }
 
@@ -249,6 +822,17 @@ static int request_line_parse(request_t *req, char *line, size_t line_len) {
            request_target_len);
     req->request_line.request_target[request_target_len] = '\0';
 
+    // Split off the query once here, so handlers never scan for it.
+    const char *query =
+        memchr(req->request_line.request_target, '?', request_target_len);
+    req->request_line.path_len =
+        query ? (size_t)(query - req->request_line.request_target)
+              : request_target_len;
+    req->request_line.query_len =
+        query ? request_target_len - req->request_line.path_len - 1 : 0;
+    req->query_indexed = 0;
+    req->path_normalized = 0;
+
     if (strcmp(req->request_line.request_target, "") == 0) {
         return PARSE_INVALID;
     }
@@ -267,25 +851,148 @@ static int request_line_parse(request_t *req, char *line, size_t line_len) {
         return PARSE_INVALID;
     }
 
+    // Only supporting HTTP/1.1
     size_t version_len = (size_t)(version_end - version_start);
-    if (version_len >= sizeof req->request_line.version) {
+    if (version_len != VERSION_SIZE - 1 ||
+        load_word(version_start) !=
+            WORD('H', 'T', 'T', 'P', '/', '1', '.', '1')) {
         return PARSE_INVALID;
     }
 
     memcpy(req->request_line.version, version_start, version_len);
     req->request_line.version[version_len] = '\0';
 
-    // Only supporting HTTP/1.1
-    if (strcmp(req->request_line.version, "HTTP/1.1") != 0) {
+    return PARSE_OK;
+}
+
+// Returns the length of the request head at the start of `data`, up to and
+// including the empty line ending it, otherwise (0) if it is incomplete.
+static size_t head_length(const char *data, size_t len) {
+    const char *end = data + len;
+    const char *cr = data;
+
+    while (end - cr >= 4 &&
+           (cr = memchr(cr, '\r', (size_t)(end - cr - 3))) != NULL) {
+        if (cr[1] == '\n' && cr[2] == '\r' && cr[3] == '\n') {
+            return (size_t)(cr - data + 4);
+        }
+
+        cr++;
+    }
+
+    return 0;
+}
+
+// Returns (1) if the request head ends within the first `room` bytes of
+// `parser.buf` followed by `chunk`, otherwise (0).
+static int head_ends_within(const char *chunk, size_t chunk_len, size_t room) {
+    static const char head_end[] = "\r\n\r\n";
+
+    size_t total = parser.bytes_read + chunk_len;
+    size_t len = total < room ? total : room;
+
+    // Consumed field lines end with a CRLF, so the buffer starts a new line.
+    size_t matched = parser.parser_state == PARSER_H ? 2 : 0;
+
+    for (size_t i = 0; i < len; ++i) {
+        char c = i < parser.bytes_read ? parser.buf[i]
+                                       : chunk[i - parser.bytes_read];
+
+        if (c == head_end[matched]) {
+            matched++;
+        } else {
+            matched = c == '\r';
+        }
+
+        if (matched == 4) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Parse a request whose head of `head_len` bytes is fully contained in
+// `chunk`, in place and in a single pass, without going through `parser.buf`.
+// Remaining bytes of `chunk` are parsed as the body.
+static int request_parse_head(request_t *req, char *chunk, size_t chunk_len,
+                              size_t head_len) {
+    char *line = chunk;
+    char *head_end = chunk + head_len - 2; /* Start of the empty line. */
+    int status;
+
+    // Null bytes are never valid in the head, and would otherwise end lines
+    // early when parsed.
+    if (memchr(chunk, '\0', head_len)) {
         return PARSE_INVALID;
     }
 
-    return PARSE_OK;
+    for (parser_state_t state = PARSER_RL; line < head_end; state = PARSER_H) {
+        // CRLF is always found, as the head ends with an empty line.
+        char *end = line;
+        while (end[0] != '\r' || end[1] != '\n') {
+            end++;
+        }
+
+        size_t line_len = (size_t)(end - line + 2);
+
+        if (state == PARSER_RL) {
+            status = request_line_parse(req, line, line_len);
+        } else if (parser.header_count++ > HEADERS_MAX_LIMIT) {
+            status = PARSE_INVALID;
+        } else {
+            status = request_header_parse(req, line, line_len);
+        }
+
+        if (status != PARSE_OK) {
+            return status;
+        }
+
+        line += line_len;
+    }
+
+    status = request_body_begin(req, chunk_len - head_len);
+    if (status != PARSE_INCOMPLETE || chunk_len == head_len) {
+        return status;
+    }
+
+    return request_body_parse(req, chunk + head_len, chunk_len - head_len);
 }
 
 int request_parse(request_t *req, char *chunk, size_t chunk_len) {
     assert(req && chunk);
 
+    size_t head_limit = req->head_limit ? req->head_limit : HEAD_LIMIT;
+
+    // Most requests arrive with the whole head in one chunk, so it is parsed
+    // in place. Fragmented heads go through the incremental state machine.
+    if (parser.parser_state == PARSER_RL && parser.bytes_read == 0) {
+        size_t head_len = head_length(chunk, chunk_len);
+
+        if (head_len > 0) {
+            int status = head_len > head_limit
+                             ? PARSE_INVALID
+                             : request_parse_head(req, chunk, chunk_len,
+                                                  head_len);
+            if (status != PARSE_INCOMPLETE && status != PARSE_CONTINUE) {
+                parser_reset();
+            }
+
+            return status;
+        }
+    }
+
+    // Body bytes are delivered straight from `chunk`, so the size of the body
+    // is not bounded by `parser.buf`.
+    if (parser.parser_state == PARSER_B) {
+        int status = request_body_parse(req, chunk, chunk_len);
+        if (status != PARSE_INCOMPLETE) {
+            parser_reset();
+        }
+
+        return status;
+    }
+
     if (chunk_len == 0) {
         // When the chunk is empty, parse and process the remaining contents
         // of `parser.buf`. Empty `chunk` should represent end of stream.
@@ -294,20 +1001,37 @@ int request_parse(request_t *req, char *chunk, size_t chunk_len) {
 
     size_t total_bytes = chunk_len + parser.bytes_read;
 
-    if (total_bytes > BODY_SIZE) {
+    // Lines are consumed one per call, so a chunk of many short lines would
+    // otherwise grow the buffer past the limit before any line is counted.
+    // Past the limit, only the start of the body may follow the head.
+    if (parser.head_bytes + total_bytes > head_limit &&
+        !head_ends_within(chunk, chunk_len, head_limit - parser.head_bytes)) {
         parser_reset();
         return PARSE_INVALID;
     }
 
+    if (!parser_reserve(total_bytes)) {
+        parser_reset();
+        return PARSE_ERR;
+    }
+
     memcpy(parser.buf + parser.bytes_read, chunk, chunk_len);
     parser.buf[total_bytes] = '\0';
     parser.bytes_read = total_bytes;
 
     char *end;
 empty_chunk:
-    if (parser.parser_state != PARSER_B &&
-        (end = strstr(parser.buf, "\r\n")) == NULL) {
-        if (chunk_len == 0) {
+    // Nothing was buffered if the stream ended before any data.
+    if (!parser.buf) {
+        parser_reset();
+        return PARSE_INVALID;
+    }
+
+    if ((end = strstr(parser.buf, "\r\n")) == NULL) {
+        // Buffered bytes all belong to the current line, so the limit can be
+        // enforced before the line is complete.
+        if (chunk_len == 0 ||
+            parser.head_bytes + parser.bytes_read > head_limit) {
             parser_reset();
             return PARSE_INVALID;
         }
@@ -320,6 +1044,12 @@ empty_chunk:
     size_t line_len = (size_t)(end - parser.buf + 2);
     char *line = parser.buf;
 
+    parser.head_bytes += line_len;
+    if (parser.head_bytes > head_limit) {
+        parser_reset();
+        return PARSE_INVALID;
+    }
+
     switch (parser.parser_state) {
         case PARSER_RL: {
             int status;
@@ -350,12 +1080,18 @@ empty_chunk:
                 parser.bytes_read -= 2;
 
                 // Transition to next state (body).
-                parser.parser_state = PARSER_B;
-                return PARSE_INCOMPLETE;
+                int status = request_body_begin(req, parser.bytes_read);
+                if (status != PARSE_INCOMPLETE && status != PARSE_CONTINUE) {
+                    parser_reset();
+                }
+
+                return status;
             }
 
-            // Check if headers limit is reached before parsing.
-            if (req->headers->size > HEADERS_MAX_LIMIT) {
+            // Check if headers limit is reached before parsing. Known headers
+            // are not stored in the table, so field lines are counted.
+            if (parser.header_count++ > HEADERS_MAX_LIMIT) {
+                parser_reset();
                 return PARSE_INVALID;
             }
 
@@ -373,21 +1109,6 @@ empty_chunk:
             // Need more data to process all field-lines (headers).
             return PARSE_INCOMPLETE;
         }
-        case PARSER_B: {
-            int status = request_body_parse(req, chunk_len);
-
-            switch (status) {
-                case PARSE_OK:
-                    break;
-                case PARSE_INCOMPLETE:
-                    return status;
-                default:
-                    parser_reset();
-                    return status;
-            }
-
-            break;
-        }
         default: {
             fprintf(stderr, "ERROR: request_parse: invalid parser state.\n");
             parser_reset();
@@ -398,3 +1119,138 @@ empty_chunk:
     parser_reset();
     return PARSE_OK;
 }
+
+void request_parse_reset(void) {
+    parser_reset();
+}
+
+void request_parse_cleanup(void) {
+    parser_reset();
+
+    for (size_t i = 0; i < SEGMENT_CLASSES; ++i) {
+        free(segment_pool[i]);
+        segment_pool[i] = NULL;
+    }
+}
+
+const char *request_header(request_t *req, const char *name) {
+    assert(req && name);
+
+    known_header_t header = known_header_lookup(name, strlen(name));
+    if (header != KNOWN_HEADERS) {
+        return req->known_headers[header];
+    }
+
+    return hash_table_lookup(req->headers, name);
+}
+
+// Index the query of `req` into `req->query_params` as `key=value` pairs
+// separated by '&'. Pairs without '=' have an empty value.
+static void request_query_index(request_t *req) {
+    request_line_t *line = &req->request_line;
+    char *pos = line->request_target + line->path_len + 1;
+    char *end = pos + line->query_len;
+
+    req->query_params_len = 0;
+    req->query_indexed = 1;
+
+    if (line->query_len == 0) {
+        return;
+    }
+
+    while (pos <= end && req->query_params_len < QUERY_PARAMS_MAX) {
+        char *pair_end = memchr(pos, '&', (size_t)(end - pos));
+        if (!pair_end) {
+            pair_end = end;
+        }
+
+        // Empty pairs, as in "a=1&&b=2", are skipped.
+        if (pair_end > pos) {
+            query_param_t *param = &req->query_params[req->query_params_len++];
+            char *eq = memchr(pos, '=', (size_t)(pair_end - pos));
+
+            param->key = pos;
+            param->key_len = (size_t)((eq ? eq : pair_end) - pos);
+            param->value = eq ? eq + 1 : pair_end;
+            param->value_len = (size_t)(pair_end - param->value);
+            param->decoded = 0;
+        }
+
+        pos = pair_end + 1;
+    }
+}
+
+const query_param_t *request_query_param(request_t *req, const char *key) {
+    assert(req && key);
+
+    if (!req->query_indexed) {
+        request_query_index(req);
+    }
+
+    size_t key_len = strlen(key);
+
+    for (size_t i = 0; i < req->query_params_len; ++i) {
+        query_param_t *param = &req->query_params[i];
+        if (param->key_len != key_len ||
+            memcmp(param->key, key, key_len) != 0) {
+            continue;
+        }
+
+        // Values live in the request's own copy of the target, so they can
+        // be rewritten in place.
+        if (!param->decoded) {
+            param->value_len =
+                uri_percent_decode(param->value, param->value_len, 1);
+            param->decoded = 1;
+        }
+
+        return param;
+    }
+
+    return NULL;
+}
+
+int request_path_normalize(request_t *req) {
+    assert(req);
+
+    // Decoding the path again would turn `%2541` into `A`, letting escapes
+    // through that were meant to stay encoded.
+    if (req->path_normalized) {
+        return req->path_normalized == 1 ? PARSE_OK : PARSE_INVALID;
+    }
+
+    request_line_t *line = &req->request_line;
+    char *path = line->request_target;
+
+    size_t path_len = uri_percent_decode(path, line->path_len, 0);
+    if (path_len != line->path_len && memchr(path, '\0', path_len)) {
+        req->path_normalized = -1;
+        return PARSE_INVALID;
+    }
+
+    req->path_normalized = 1;
+
+    path_len = uri_path_normalize(path, path_len);
+
+    size_t shift = line->path_len - path_len;
+    if (shift == 0) {
+        return PARSE_OK;
+    }
+
+    // Query, with its leading '?' and the null-terminator, follows the path.
+    // Decoded query values may hold null bytes, so it is not scanned for.
+    size_t tail = 1;
+    if (path[line->path_len] == '?') {
+        tail += 1 + line->query_len;
+    }
+
+    memmove(path + path_len, path + line->path_len, tail);
+    line->path_len = path_len;
+
+    for (size_t i = 0; i < req->query_params_len; ++i) {
+        req->query_params[i].key -= shift;
+        req->query_params[i].value -= shift;
+    }
+
+    return PARSE_OK;
+}
@@ -0,0 +1,226 @@
+#include "uri.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Returns the index of the first byte of `str` equal to `a` or `b`, otherwise
+// `len`. Targets are mostly literal bytes, so they are scanned 16 at a time
+// where SSE2 is available.
+static size_t find_either(const char *str, size_t len, char a, char b) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(str + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, va),
+                                                  _mm_cmpeq_epi8(block, vb)));
+        if (mask) {
+            return i + (size_t)__builtin_ctz((unsigned)mask);
+        }
+    }
+#endif
+
+    for (; i < len; ++i) {
+        if (str[i] == a || str[i] == b) {
+            return i;
+        }
+    }
+
+    return len;
+}
+
+#ifdef __SSE2__
+// Decodes the escapes at the start of `str` into `out` five at a time, for as
+// long as each next 15 bytes are well-formed escapes, as in encoded IDs. SSE2
+// has no byte shuffle, so the five bytes decoded from a block are picked out
+// of it one by one. Returns the number of escapes decoded.
+static size_t escapes_decode(char *out, const char *str, size_t len) {
+    const __m128i percent = _mm_set1_epi8('%');
+    const __m128i fold = _mm_set1_epi8(0x20);
+    size_t n = 0;
+
+    for (; len >= 16; str += 15, len -= 15) {
+        __m128i block = _mm_loadu_si128((const __m128i *)str);
+        __m128i lower = _mm_or_si128(block, fold);
+
+        __m128i digit =
+            _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('0' - 1)),
+                          _mm_cmplt_epi8(block, _mm_set1_epi8('9' + 1)));
+        __m128i alpha =
+            _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                          _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+
+        // A '%' every third byte, each followed by two hex digits. The last
+        // byte of the block belongs to the next one.
+        unsigned escapes =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, percent));
+        __m128i is_hex = _mm_or_si128(digit, alpha);
+        unsigned hex = (unsigned)_mm_movemask_epi8(is_hex);
+        if ((escapes & 0x7fff) != 0x1249 || (hex & 0x6db6) != 0x6db6) {
+            break;
+        }
+
+        // Bytes other than hex digits are cleared, so every value is below 16
+        // and shifting the 16-bit lanes never carries into the next byte.
+        __m128i value = _mm_and_si128(
+            is_hex,
+            _mm_or_si128(
+                _mm_and_si128(digit, _mm_sub_epi8(block, _mm_set1_epi8('0'))),
+                _mm_andnot_si128(
+                    digit, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)))));
+
+        // Each high digit is joined with the low digit following it.
+        unsigned char decoded[16];
+        _mm_storeu_si128((__m128i *)decoded,
+                         _mm_or_si128(_mm_slli_epi16(value, 4),
+                                      _mm_srli_si128(value, 1)));
+
+        for (size_t j = 0; j < 5; ++j) {
+            out[n + j] = (char)decoded[3 * j + 1];
+        }
+        n += 5;
+    }
+
+    return n;
+}
+#endif
+
+// Returns (1) if `path` has a '.' byte or repeated slashes, otherwise (0).
+static int path_needs_normalize(const char *path, size_t len) {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i dot = _mm_set1_epi8('.');
+    const __m128i slash = _mm_set1_epi8('/');
+    unsigned carry = 0; /* Set if the previous block ended with a slash. */
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(path + i));
+        unsigned dots = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, dot));
+        unsigned slashes =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, slash));
+
+        // A slash preceded by another, within the block or across blocks.
+        if (dots || (slashes & ((slashes << 1) | carry))) {
+            return 1;
+        }
+
+        carry = slashes >> 15;
+    }
+#endif
+
+    for (; i < len; ++i) {
+        if (path[i] == '.' || (path[i] == '/' && i > 0 && path[i - 1] == '/')) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+size_t uri_percent_decode(char *str, size_t len, int plus_as_space) {
+    assert(str || len == 0);
+
+    // Searching for '%' twice when '+' is kept keeps the scan branch-free.
+    char plus = plus_as_space ? '+' : '%';
+
+    // Nothing is rewritten before the first byte that decodes to something
+    // else, so input without any is left untouched.
+    size_t i = find_either(str, len, '%', plus);
+    size_t out = i;
+
+    while (i < len) {
+        int hi, lo;
+#ifdef __SSE2__
+        size_t n;
+#endif
+
+        if (str[i] == '+') {
+            str[out++] = ' ';
+            i++;
+#ifdef __SSE2__
+        } else if ((n = escapes_decode(str + out, str + i, len - i)) > 0) {
+            // Output trails the input by two bytes per escape, so the decoded
+            // bytes never overwrite a block before it is loaded.
+            out += n;
+            i += 3 * n;
+#endif
+        } else if (len - i > 2 && (hi = uri_hex_value(str[i + 1])) != -1 &&
+                   (lo = uri_hex_value(str[i + 2])) != -1) {
+            str[out++] = (char)(hi << 4 | lo);
+            i += 3;
+        } else {
+            // Malformed escapes are kept as they are.
+            str[out++] = '%';
+            i++;
+        }
+
+        // Move the run of literal bytes up to the next escape at once.
+        size_t run = find_either(str + i, len - i, '%', plus);
+        memmove(str + out, str + i, run);
+        out += run;
+        i += run;
+    }
+
+    return out;
+}
+
+size_t uri_path_normalize(char *path, size_t len) {
+    assert(path || len == 0);
+
+    if (len == 0 || path[0] != '/' || !path_needs_normalize(path, len)) {
+        return len;
+    }
+
+    // Output is never longer than the input consumed so far, so segments are
+    // moved towards the front of the same buffer.
+    size_t out = 0;
+    size_t pos = 0;
+
+    while (pos < len) {
+        // `pos` is at a slash, repeated slashes are merged into one.
+        size_t seg = pos + 1;
+        while (seg < len && path[seg] == '/') {
+            seg++;
+        }
+
+        const char *slash = memchr(path + seg, '/', len - seg);
+        size_t end = slash ? (size_t)(slash - path) : len;
+        size_t seg_len = end - seg;
+
+        if (seg_len == 1 && path[seg] == '.') {
+            // Removed, keeping the slash when it is the last segment.
+            if (end == len) {
+                path[out++] = '/';
+            }
+        } else if (seg_len == 2 && path[seg] == '.' && path[seg + 1] == '.') {
+            // Removes the last output segment, never going above the root.
+            while (out > 0 && path[out - 1] != '/') {
+                out--;
+            }
+
+            if (out > 0) {
+                out--;
+            }
+
+            if (end == len) {
+                path[out++] = '/';
+            }
+        } else {
+            path[out++] = '/';
+            memmove(path + out, path + seg, seg_len);
+            out += seg_len;
+        }
+
+        pos = end;
+    }
+
+    return out;
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_ADMISSION_H
+#define TEST_ADMISSION_H
+
+#include "admission.h"
+#include "test_common.h"
+
+void test_admission_all(void);
+
+#endif  // TEST_ADMISSION_H
@@ -0,0 +1,10 @@
+#ifndef TEST_URI_H
+#define TEST_URI_H
+
+#include "request.h"
+#include "test_common.h"
+#include "uri.h"
+
+void test_uri_all(void);
+
+#endif  // TEST_URI_H
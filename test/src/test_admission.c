@@ -0,0 +1,179 @@
+#include "test_admission.h"
+
+#define MAX_TOTAL 64
+#define MAX_PER_ADDR 4
+
+static connection_t make_conn(uint32_t ipv4) {
+    connection_t conn;
+    memset(&conn, 0, sizeof conn);
+
+    conn.remote_family = AF_INET;
+    memcpy(conn.remote_bin, &ipv4, sizeof ipv4);
+    conn.clientfd = -1;
+
+    return conn;
+}
+
+void test_admission_init(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, MAX_PER_ADDR);
+    assert(adm != NULL);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_per_addr_limit(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, MAX_PER_ADDR);
+    assert(adm != NULL);
+
+    connection_t conn = make_conn(0x0100007f);
+
+    for (size_t i = 0; i < MAX_PER_ADDR; ++i) {
+        assert(admission_acquire(adm, &conn) == ADMIT_OK);
+    }
+    assert(admission_acquire(adm, &conn) == ADMIT_LIMIT_ADDR);
+
+    // Other addresses are unaffected.
+    connection_t other = make_conn(0x0200007f);
+    assert(admission_acquire(adm, &other) == ADMIT_OK);
+
+    // Releasing a connection makes room for the same address again.
+    admission_release(adm, &conn);
+    assert(admission_acquire(adm, &conn) == ADMIT_OK);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_total_limit(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, MAX_PER_ADDR);
+    assert(adm != NULL);
+
+    for (uint32_t i = 0; i < MAX_TOTAL; ++i) {
+        connection_t conn = make_conn(i);
+        assert(admission_acquire(adm, &conn) == ADMIT_OK);
+    }
+
+    connection_t conn = make_conn(MAX_TOTAL);
+    assert(admission_acquire(adm, &conn) == ADMIT_LIMIT_TOTAL);
+
+    connection_t first = make_conn(0);
+    admission_release(adm, &first);
+    assert(admission_acquire(adm, &conn) == ADMIT_OK);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_family_is_part_of_key(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, 1);
+    assert(adm != NULL);
+
+    connection_t v4 = make_conn(0x0100007f);
+    connection_t v6 = v4;
+    v6.remote_family = AF_INET6;
+
+    assert(admission_acquire(adm, &v4) == ADMIT_OK);
+    assert(admission_acquire(adm, &v6) == ADMIT_OK);
+    assert(admission_acquire(adm, &v4) == ADMIT_LIMIT_ADDR);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_ipv6_prefix(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, 2);
+    assert(adm != NULL);
+
+    // 2001:db8::/64, with a different interface identifier per connection.
+    connection_t v6 = make_conn(0);
+    v6.remote_family = AF_INET6;
+    v6.remote_bin[0] = 0x20;
+    v6.remote_bin[1] = 0x01;
+    v6.remote_bin[2] = 0x0d;
+    v6.remote_bin[3] = 0xb8;
+
+    v6.remote_bin[15] = 1;
+    assert(admission_acquire(adm, &v6) == ADMIT_OK);
+    v6.remote_bin[15] = 2;
+    assert(admission_acquire(adm, &v6) == ADMIT_OK);
+    v6.remote_bin[8] = 0xff;
+    assert(admission_acquire(adm, &v6) == ADMIT_LIMIT_ADDR);
+
+    // Another /64 is a different client.
+    v6.remote_bin[7] = 1;
+    assert(admission_acquire(adm, &v6) == ADMIT_OK);
+
+    // Releases are accounted to the prefix as well.
+    v6.remote_bin[7] = 0;
+    admission_release(adm, &v6);
+    assert(admission_acquire(adm, &v6) == ADMIT_OK);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_ipv4_mapped(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, 1);
+    assert(adm != NULL);
+
+    connection_t v4 = make_conn(0x0100007f);
+
+    // ::ffff:127.0.0.1
+    connection_t mapped = make_conn(0);
+    mapped.remote_family = AF_INET6;
+    mapped.remote_bin[10] = 0xff;
+    mapped.remote_bin[11] = 0xff;
+    memcpy(mapped.remote_bin + 12, v4.remote_bin, 4);
+
+    assert(admission_acquire(adm, &v4) == ADMIT_OK);
+    assert(admission_acquire(adm, &mapped) == ADMIT_LIMIT_ADDR);
+
+    admission_release(adm, &mapped);
+    assert(admission_acquire(adm, &mapped) == ADMIT_OK);
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_churn(void) {
+    admission_t *adm = admission_init(MAX_TOTAL, MAX_PER_ADDR);
+    assert(adm != NULL);
+
+    // Held across every purge of the table.
+    connection_t held = make_conn(0xffffffff);
+    for (size_t i = 0; i < MAX_PER_ADDR; ++i) {
+        assert(admission_acquire(adm, &held) == ADMIT_OK);
+    }
+
+    // Many distinct short-lived addresses leave tombstones behind, which must
+    // not exhaust the table.
+    for (uint32_t i = 0; i < 100000; ++i) {
+        connection_t conn = make_conn(i);
+        assert(admission_acquire(adm, &conn) == ADMIT_OK);
+        admission_release(adm, &conn);
+    }
+
+    assert(admission_acquire(adm, &held) == ADMIT_LIMIT_ADDR);
+    for (size_t i = 0; i < MAX_PER_ADDR; ++i) {
+        admission_release(adm, &held);
+    }
+
+    for (uint32_t i = 0; i < MAX_TOTAL; ++i) {
+        connection_t conn = make_conn(i);
+        assert(admission_acquire(adm, &conn) == ADMIT_OK);
+    }
+
+    admission_free(adm);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_admission_all(void) {
+    test_admission_init();
+    test_admission_per_addr_limit();
+    test_admission_total_limit();
+    test_admission_family_is_part_of_key();
+    test_admission_ipv6_prefix();
+    test_admission_ipv4_mapped();
+    test_admission_churn();
+}
@@ -20,6 +20,35 @@ void test_hash_table_init(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_hash_table_seeded_hash(void) {
+    const char *upper = "AbCdEfGhIjKlMnOpQrStUvWxYz-0123456789_Zz";
+    const char *lower = "abcdefghijklmnopqrstuvwxyz-0123456789_zz";
+
+    // Every length handled by the word loop and the remaining bytes.
+    for (size_t len = 0; len <= strlen(upper); len++) {
+        assert(hash_table_seeded_hash(upper, len) ==
+               hash_table_seeded_hash(lower, len));
+    }
+
+    // Only ASCII letters are folded.
+    assert(hash_table_seeded_hash("[", 1) != hash_table_seeded_hash("{", 1));
+    assert(hash_table_seeded_hash("@", 1) != hash_table_seeded_hash("`", 1));
+    assert(hash_table_seeded_hash("\xc1", 1) !=
+           hash_table_seeded_hash("\xe1", 1));
+
+    assert(hash_table_seeded_hash("content-type", 12) !=
+           hash_table_seeded_hash("content-typf", 12));
+    assert(hash_table_seeded_hash("a", 1) != hash_table_seeded_hash("a", 0));
+
+    // Binary keys keep their case.
+    assert(hash_table_seeded_binary_hash(upper, 40) !=
+           hash_table_seeded_binary_hash(lower, 40));
+    assert(hash_table_seeded_binary_hash("0123", 4) ==
+           hash_table_seeded_hash("0123", 4));
+
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_hash_table_init_with_hash(void) {
     hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, bad_hash);
     assert(ht != NULL);
@@ -75,6 +104,73 @@ void test_hash_table_duplicate_insertion(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_hash_table_values(void) {
+    char arena_buf[16 * 1024];
+    ht_arena_t arena = {.buf = arena_buf, .size = sizeof(arena_buf)};
+
+    hash_table_t *tables[] = {hash_table_init(HASH_TABLE_SIZE, NULL),
+                              hash_table_init_arena(16, NULL, &arena)};
+
+    for (size_t t = 0; t < sizeof(tables) / sizeof(tables[0]); t++) {
+        hash_table_t *ht = tables[t];
+        assert(ht != NULL);
+
+        ht_value_iter_t iter;
+        assert(hash_table_values(ht, "cookie", &iter) == 0);
+        assert(hash_table_value_next(&iter) == NULL);
+
+        assert(hash_table_insert(ht, "Cookie", "a=1"));
+        assert(hash_table_values(ht, "cookie", &iter) == 1);
+        assert(strcmp(hash_table_value_next(&iter), "a=1") == 0);
+        assert(hash_table_value_next(&iter) == NULL);
+
+        // Each value is kept as inserted, and joined only once looked up.
+        for (size_t i = 2; i <= 100; i++) {
+            char value[32];
+            snprintf(value, sizeof(value), "a=%zu", i);
+            assert(hash_table_insert(ht, "COOKIE", value));
+
+            if (i == 3) {
+                assert(strcmp(hash_table_lookup(ht, "cookie"),
+                              "a=1, a=2, a=3") == 0);
+            }
+        }
+
+        assert(hash_table_values(ht, "Cookie", &iter) == 100);
+        for (size_t i = 1; i <= 100; i++) {
+            char value[32];
+            snprintf(value, sizeof(value), "a=%zu", i);
+            assert(strcmp(hash_table_value_next(&iter), value) == 0);
+        }
+        assert(hash_table_value_next(&iter) == NULL);
+
+        const char *joined = hash_table_lookup(ht, "cookie");
+        assert(strncmp(joined, "a=1, a=2, ", 10) == 0);
+        assert(strcmp(joined + strlen(joined) - 11, "a=99, a=100") == 0);
+
+        // The joined list is built once until the next insertion.
+        assert(hash_table_lookup(ht, "cookie") == joined);
+
+        hash_table_frozen_t *ft = hash_table_freeze(ht);
+        assert(ft != NULL);
+        assert(strcmp(hash_table_frozen_lookup(ft, "cookie"), joined) == 0);
+        hash_table_frozen_free(ft);
+
+        assert(hash_table_delete(ht, "cookie"));
+        assert(hash_table_lookup(ht, "cookie") == NULL);
+        assert(hash_table_values(ht, "cookie", &iter) == 0);
+
+        assert(hash_table_insert(ht, "x-forwarded-for", "10.0.0.1"));
+        assert(hash_table_insert(ht, "x-forwarded-for", "10.0.0.2"));
+        hash_table_reset(ht);
+        assert(hash_table_lookup(ht, "x-forwarded-for") == NULL);
+
+        hash_table_free(ht);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_hash_table_resize(void) {
     hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, NULL);
     assert(ht != NULL);
@@ -97,6 +193,53 @@ void test_hash_table_resize(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_hash_table_resize_keeps_values(void) {
+    hash_table_t *ht = hash_table_init(16, NULL);
+    assert(ht != NULL);
+
+    assert(hash_table_insert(ht, "key", "value"));
+    char *value = hash_table_lookup(ht, "key");
+
+    for (size_t i = 0; i < 64; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "key%zu", i);
+        assert(hash_table_insert(ht, key, "other"));
+    }
+
+    // Entries are moved on resize, without copying their values.
+    assert(ht->capacity > 16);
+    assert(hash_table_lookup(ht, "key") == value);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_collisions(void) {
+    hash_table_t *ht = hash_table_init(16, bad_hash);
+    assert(ht != NULL);
+
+    // Keys of the same length and first byte share a hash with `bad_hash`.
+    for (size_t i = 0; i < 100; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "k%03zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    for (size_t i = 0; i < 100; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "K%03zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(strcmp(hash_table_lookup(ht, key), value) == 0);
+    }
+
+    assert(hash_table_lookup(ht, "k100") == NULL);
+    assert(hash_table_lookup(ht, "k00") == NULL);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_hash_table_special_characters(void) {
     hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, NULL);
     assert(ht != NULL);
@@ -119,6 +262,45 @@ void test_hash_table_lookup_case_insensitive(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_hash_table_lookup_long_key(void) {
+    ht_hash_fn hash_fns[] = {NULL, hash_table_default_hash};
+
+    for (size_t h = 0; h < sizeof(hash_fns) / sizeof(hash_fns[0]); h++) {
+        hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, hash_fns[h]);
+        assert(ht != NULL);
+
+        // Longer than any lowercase copy kept on the stack, with a length
+        // that is not a multiple of the word size.
+        char key[4099], upper[4099];
+        for (size_t i = 0; i < sizeof(key) - 1; i++) {
+            key[i] = (char)('a' + i % 26);
+            upper[i] = (char)('A' + i % 26);
+        }
+        key[sizeof(key) - 1] = upper[sizeof(upper) - 1] = '\0';
+
+        assert(hash_table_insert(ht, upper, "long_value"));
+        assert(strcmp(hash_table_lookup(ht, key), "long_value") == 0);
+        assert(strcmp(hash_table_lookup(ht, upper), "long_value") == 0);
+
+        hash_table_frozen_t *ft = hash_table_freeze(ht);
+        assert(ft != NULL);
+        assert(strcmp(hash_table_frozen_lookup(ft, upper), "long_value") == 0);
+        hash_table_frozen_free(ft);
+
+        // A difference in the last byte.
+        upper[sizeof(upper) - 2] = '@';
+        assert(hash_table_lookup(ht, upper) == NULL);
+        assert(hash_table_delete(ht, upper) == 0);
+
+        assert(hash_table_delete(ht, key));
+        assert(hash_table_lookup(ht, key) == NULL);
+
+        hash_table_free(ht);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_hash_table_empty_key(void) {
     hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, NULL);
     assert(ht != NULL);
@@ -291,15 +473,419 @@ void test_hash_table_probing_sequence(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_hash_table_arena(void) {
+    char buf[16 * 1024];
+    ht_arena_t arena = {.buf = buf, .size = sizeof buf};
+
+    hash_table_t *ht = hash_table_init_arena(16, NULL, &arena);
+    assert(ht != NULL);
+    assert(ht->capacity == 16);
+
+    size_t mark = arena.used;
+    size_t used = 0;
+
+    for (size_t round = 0; round < 3; round++) {
+        // Enough keys to resize the table at least once.
+        for (size_t i = 0; i < 20; i++) {
+            char key[32], value[32];
+            snprintf(key, sizeof(key), "X-Header-%zu", i);
+            snprintf(value, sizeof(value), "value%zu", i);
+            assert(hash_table_insert(ht, key, value));
+        }
+
+        assert(ht->size == 20);
+        assert(ht->capacity > 16);
+        assert(strcmp(hash_table_lookup(ht, "x-header-7"), "value7") == 0);
+
+        // The same keys take the same arena space every round.
+        assert(round == 0 || arena.used == used);
+        used = arena.used;
+
+        hash_table_reset(ht);
+        assert(arena.used == mark);
+        assert(ht->capacity == 16);
+        assert(ht->size == 0);
+        assert(hash_table_lookup(ht, "x-header-7") == NULL);
+    }
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_arena_exhausted(void) {
+    char buf[2048];
+    ht_arena_t arena = {.buf = buf, .size = sizeof buf};
+
+    // Too small for the entries, which are released again.
+    ht_arena_t tiny = {.buf = buf, .size = 256};
+    assert(hash_table_init_arena(16, NULL, &tiny) == NULL);
+    assert(tiny.used == 0);
+
+    hash_table_t *ht = hash_table_init_arena(16, NULL, &arena);
+    assert(ht != NULL);
+
+    char value[512];
+    memset(value, 'v', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+
+    assert(hash_table_insert(ht, "key0", value));
+
+    // Insertions fail once the arena runs out, leaving earlier ones intact.
+    char key[32];
+    for (size_t i = 1;; i++) {
+        assert(i < 4);
+
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (!hash_table_insert(ht, key, value)) {
+            break;
+        }
+    }
+
+    assert(strcmp(hash_table_lookup(ht, "key0"), value) == 0);
+    assert(hash_table_lookup(ht, key) == NULL);
+    assert(arena.used <= arena.size);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_reset(void) {
+    hash_table_t *ht = hash_table_init(HASH_TABLE_SIZE, NULL);
+    assert(ht != NULL);
+
+    assert(hash_table_insert(ht, "key1", "value1"));
+    assert(hash_table_insert(ht, "key2", "value2"));
+
+    hash_table_reset(ht);
+    assert(ht->size == 0);
+    assert(hash_table_lookup(ht, "key1") == NULL);
+
+    assert(hash_table_insert(ht, "key1", "value3"));
+    assert(strcmp(hash_table_lookup(ht, "key1"), "value3") == 0);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+// Inserts, looks up and deletes enough keys in `ht` to resize it a few times.
+static void exercise_table(hash_table_t *ht) {
+    char key[32], value[32];
+
+    for (size_t i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "Key%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    assert(ht->size == 5000);
+
+    for (size_t i = 0; i < 5000; i += 2) {
+        snprintf(key, sizeof(key), "KEY%zu", i);
+        assert(hash_table_delete(ht, key));
+    }
+
+    assert(ht->size == 2500);
+
+    for (size_t i = 0; i < 5000; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+
+        if (i % 2 == 0) {
+            assert(hash_table_lookup(ht, key) == NULL);
+        } else {
+            assert(strcmp(hash_table_lookup(ht, key), value) == 0);
+        }
+    }
+
+    assert(hash_table_insert(ht, "key1", "again"));
+    assert(strcmp(hash_table_lookup(ht, "key1"), "value1, again") == 0);
+    assert(ht->size == 2500);
+}
+
+void test_hash_table_swiss(void) {
+    ht_opts_t opts = {.probe = HT_PROBE_SWISS};
+
+    hash_table_t *ht = hash_table_init_opts(4, &opts);
+    assert(ht != NULL);
+    assert(ht->capacity == 16);
+
+    exercise_table(ht);
+    assert(ht->ctrl != NULL);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_swiss_collisions(void) {
+    ht_opts_t opts = {.hash_fn = bad_hash, .probe = HT_PROBE_SWISS};
+
+    hash_table_t *ht = hash_table_init_opts(16, &opts);
+    assert(ht != NULL);
+
+    for (size_t i = 0; i < 100; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "k%03zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    for (size_t i = 0; i < 100; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "K%03zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(strcmp(hash_table_lookup(ht, key), value) == 0);
+    }
+
+    assert(hash_table_delete(ht, "k050"));
+    assert(hash_table_lookup(ht, "k050") == NULL);
+    assert(strcmp(hash_table_lookup(ht, "k099"), "value99") == 0);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_incremental(void) {
+    ht_probe_t probes[] = {HT_PROBE_QUADRATIC, HT_PROBE_SWISS,
+                           HT_PROBE_ROBIN_HOOD};
+
+    for (size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); p++) {
+        ht_opts_t opts = {.probe = probes[p], .incremental = 1};
+
+        hash_table_t *ht = hash_table_init_opts(64, &opts);
+        assert(ht != NULL);
+
+        exercise_table(ht);
+
+        // Entries left to migrate are found, updated and deleted in place.
+        size_t migrating = 0;
+        char key[32], value[32];
+
+        for (size_t i = 5000; i < 20000; i++) {
+            snprintf(key, sizeof(key), "key%zu", i);
+            snprintf(value, sizeof(value), "value%zu", i);
+            assert(hash_table_insert(ht, key, value));
+
+            if (!ht->old_entries) {
+                continue;
+            }
+
+            migrating++;
+            assert(strcmp(hash_table_lookup(ht, "key4999"), "value4999") == 0);
+
+            snprintf(key, sizeof(key), "key%zu", i - 1000);
+            assert(hash_table_delete(ht, key));
+            assert(hash_table_lookup(ht, key) == NULL);
+        }
+
+        assert(migrating > 0);
+        assert(strcmp(hash_table_lookup(ht, "key1"), "value1, again") == 0);
+
+        // Resize again, then free with the migration incomplete.
+        for (size_t i = 20000; !ht->old_entries; i++) {
+            snprintf(key, sizeof(key), "key%zu", i);
+            assert(hash_table_insert(ht, key, "value"));
+        }
+
+        hash_table_free(ht);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_small(void) {
+    hash_table_t *ht = hash_table_init(64, NULL);
+    assert(ht != NULL);
+    assert(ht->small);
+
+    char key[32], value[32];
+    for (size_t i = 0; i < 16; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    assert(ht->small);
+    assert(hash_table_insert(ht, "KEY3", "again"));
+    assert(strcmp(hash_table_lookup(ht, "key3"), "value3, again") == 0);
+
+    // Deleting moves the last entry into the freed slot.
+    assert(hash_table_delete(ht, "key0"));
+    assert(!hash_table_delete(ht, "key0"));
+    assert(strcmp(hash_table_lookup(ht, "key15"), "value15") == 0);
+    assert(ht->size == 15);
+
+    assert(hash_table_insert(ht, "key0", "value0"));
+    assert(hash_table_insert(ht, "key16", "value16"));
+    assert(!ht->small);
+    assert(ht->capacity == 64);
+    assert(ht->size == 17);
+
+    for (size_t i = 0; i < 17; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+
+        if (i != 3) {
+            assert(strcmp(hash_table_lookup(ht, key), value) == 0);
+        }
+    }
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_robin_hood(void) {
+    ht_opts_t opts = {.probe = HT_PROBE_ROBIN_HOOD};
+
+    hash_table_t *ht = hash_table_init_opts(16, &opts);
+    assert(ht != NULL);
+
+    exercise_table(ht);
+
+    // Deletion shifts entries back instead of leaving tombstones.
+    assert(ht->tombstones == 0);
+
+    hash_table_free(ht);
+
+    // Long runs of entries sharing a home slot, with their neighbours.
+    opts.hash_fn = bad_hash;
+
+    ht = hash_table_init_opts(16, &opts);
+    assert(ht != NULL);
+
+    char key[32], value[32];
+    for (size_t i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "%c%03zu", (int)('a' + i % 3), i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    for (size_t i = 0; i < 300; i += 2) {
+        snprintf(key, sizeof(key), "%c%03zu", (int)('a' + i % 3), i);
+        assert(hash_table_delete(ht, key));
+    }
+
+    for (size_t i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "%c%03zu", (int)('A' + i % 3), i);
+        snprintf(value, sizeof(value), "value%zu", i);
+
+        if (i % 2 == 0) {
+            assert(hash_table_lookup(ht, key) == NULL);
+        } else {
+            assert(strcmp(hash_table_lookup(ht, key), value) == 0);
+        }
+    }
+
+    assert(ht->size == 150);
+    assert(ht->tombstones == 0);
+
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+// Looks up every key of the frozen table `arg` from another thread.
+static void *frozen_reader(void *arg) {
+    const hash_table_frozen_t *ft = arg;
+
+    for (size_t i = 0; i < 1000; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "KEY%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(strcmp(hash_table_frozen_lookup(ft, key), value) == 0);
+    }
+
+    return NULL;
+}
+
+void test_hash_table_freeze(void) {
+    ht_opts_t opts = {.incremental = 1};
+
+    hash_table_t *ht = hash_table_init_opts(64, &opts);
+    assert(ht != NULL);
+
+    for (size_t i = 0; i < 1000; i++) {
+        char key[32], value[32];
+        snprintf(key, sizeof(key), "key%zu", i);
+        snprintf(value, sizeof(value), "value%zu", i);
+        assert(hash_table_insert(ht, key, value));
+    }
+
+    assert(hash_table_delete(ht, "key999"));
+    assert(hash_table_insert(ht, "key999", "value999"));
+
+    hash_table_frozen_t *ft = hash_table_freeze(ht);
+    assert(ft != NULL);
+
+    // The frozen table does not depend on the original.
+    hash_table_free(ht);
+
+    pthread_t readers[4];
+    for (size_t i = 0; i < 4; i++) {
+        assert(pthread_create(&readers[i], NULL, frozen_reader, ft) == 0);
+    }
+
+    for (size_t i = 0; i < 4; i++) {
+        assert(pthread_join(readers[i], NULL) == 0);
+    }
+
+    assert(hash_table_frozen_lookup(ft, "key1000") == NULL);
+    assert(hash_table_frozen_lookup(ft, "") == NULL);
+
+    hash_table_frozen_free(ft);
+
+    // Empty tables freeze as well.
+    ht = hash_table_init(HASH_TABLE_SIZE, NULL);
+    assert(ht != NULL);
+
+    ft = hash_table_freeze(ht);
+    assert(ft != NULL);
+    assert(hash_table_frozen_lookup(ft, "key") == NULL);
+
+    hash_table_frozen_free(ft);
+    hash_table_free(ht);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_hash_table_churn(void) {
+    ht_probe_t probes[] = {HT_PROBE_QUADRATIC, HT_PROBE_SWISS,
+                           HT_PROBE_ROBIN_HOOD};
+
+    for (size_t p = 0; p < sizeof(probes) / sizeof(probes[0]); p++) {
+        ht_opts_t opts = {.probe = probes[p]};
+
+        hash_table_t *ht = hash_table_init_opts(64, &opts);
+        assert(ht != NULL);
+
+        // Tombstones are dropped by rehashing instead of growing the table.
+        for (size_t i = 0; i < 100000; i++) {
+            char key[32];
+            snprintf(key, sizeof(key), "key%zu", i);
+            assert(hash_table_insert(ht, key, "value"));
+            assert(hash_table_delete(ht, key));
+        }
+
+        assert(ht->size == 0);
+        assert(ht->capacity == 64);
+
+        hash_table_free(ht);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_hash_table_all() {
     test_hash_table_init();
+    test_hash_table_seeded_hash();
     test_hash_table_init_with_hash();
     test_hash_table_insert_lookup();
     test_hash_table_delete();
     test_hash_table_duplicate_insertion();
+    test_hash_table_values();
     test_hash_table_resize();
+    test_hash_table_resize_keeps_values();
+    test_hash_table_collisions();
     test_hash_table_special_characters();
     test_hash_table_lookup_case_insensitive();
+    test_hash_table_lookup_long_key();
     test_hash_table_empty_key();
     test_hash_table_empty_value();
     test_hash_table_stress_test_insert();
@@ -309,4 +895,14 @@ void test_hash_table_all() {
     test_hash_table_nonexistent_keys();
     test_hash_table_collision_after_mass_deletion();
     test_hash_table_probing_sequence();
+    test_hash_table_arena();
+    test_hash_table_arena_exhausted();
+    test_hash_table_reset();
+    test_hash_table_swiss();
+    test_hash_table_swiss_collisions();
+    test_hash_table_incremental();
+    test_hash_table_small();
+    test_hash_table_robin_hood();
+    test_hash_table_churn();
+    test_hash_table_freeze();
 }
@@ -2,6 +2,126 @@
 
 #define MAX_BYTES_PER_READ 10
 
+#define STREAM_BODY_SIZE 20000
+#define STREAM_MAX_BYTES_PER_READ 256
+
+typedef struct {
+    char *expected;  /* Body the callback should receive. */
+    size_t received; /* Bytes received so far. */
+    int status;      /* Status returned by the callback. */
+} stream_ctx_t;
+
+// Build a chunked request carrying the same body as `stream_request`, split
+// into chunks of varying size, returning the request and pointing `body` at a
+// copy of the decoded body.
+static char *chunked_request(size_t body_len, char **body) {
+    static const char head[] =
+        "POST /upload HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n";
+
+    // Each chunk adds at most a 16 digit size, an extension and two CRLFs.
+    size_t cap = sizeof head + body_len * 2 + 64;
+    char *data = malloc(cap);
+    *body = malloc(body_len + 1);
+    assert(data && *body);
+
+    for (size_t i = 0; i < body_len; ++i) {
+        (*body)[i] = (char)('a' + (i % 26));
+    }
+    (*body)[body_len] = '\0';
+
+    size_t len = sizeof head - 1;
+    memcpy(data, head, len);
+
+    for (size_t off = 0, size = 1; off < body_len; off += size, size *= 3) {
+        if (size > body_len - off) {
+            size = body_len - off;
+        }
+
+        len += (size_t)snprintf(data + len, cap - len, "%zx;n=v\r\n", size);
+        memcpy(data + len, *body + off, size);
+        len += size;
+        memcpy(data + len, "\r\n", 2);
+        len += 2;
+    }
+
+    len += (size_t)snprintf(data + len, cap - len,
+                            "0\r\nChecksum: abc\r\n\r\n");
+    assert(len < cap);
+
+    return data;
+}
+
+static int stream_cb(void *ctx, const char *data, size_t len) {
+    stream_ctx_t *sc = ctx;
+
+    assert(memcmp(sc->expected + sc->received, data, len) == 0);
+    sc->received += len;
+
+    return sc->status;
+}
+
+// Build a request with a body of `body_len` bytes, returning the request and
+// pointing `body` at the start of its body.
+static char *stream_request(size_t body_len, char **body) {
+    char head[128];
+    int head_len =
+        snprintf(head, sizeof head,
+                 "POST /upload HTTP/1.1\r\n"
+                 "Host: example.com\r\n"
+                 "Content-Length: %zu\r\n"
+                 "\r\n",
+                 body_len);
+    assert(head_len > 0);
+
+    char *data = malloc((size_t)head_len + body_len + 1);
+    assert(data);
+
+    memcpy(data, head, (size_t)head_len);
+    *body = data + head_len;
+
+    for (size_t i = 0; i < body_len; ++i) {
+        (*body)[i] = (char)('a' + (i % 26));
+    }
+    (*body)[body_len] = '\0';
+
+    return data;
+}
+
+// Parse `data` into `req`, reading between 1 and `max_bytes_per_read` bytes,
+// inclusive, at a time.
+static int stream_parse(request_t *req, char *data,
+                        size_t max_bytes_per_read) {
+    chunk_reader_t reader = {
+        .data = data,
+        .bytes_per_read = 1,
+        .pos = 0,
+    };
+
+    char buf[STREAM_MAX_BYTES_PER_READ + 1];
+
+    int status;
+    size_t bytes_read;
+    while (1) {
+        reader.bytes_per_read = (size_t)rand() % max_bytes_per_read + 1;
+
+        bytes_read = chunk_reader_read(&reader, buf, sizeof buf);
+        if (bytes_read == 0) {
+            while ((status = request_parse(req, "", 0)) == PARSE_INCOMPLETE);
+            break;
+        }
+
+        if ((status = request_parse(req, buf, bytes_read)) !=
+            PARSE_INCOMPLETE) {
+            break;
+        }
+    }
+
+    return status;
+}
+
 void test_request_body_valid(void) {
     request_t req = {
         .request_line = {0},
@@ -388,6 +508,432 @@ void test_request_body_invalid_content_length(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_request_body_stream_large(void) {
+    char *body;
+    char *data = stream_request(STREAM_BODY_SIZE, &body);
+
+    stream_ctx_t ctx = {.expected = body, .received = 0, .status = PARSE_OK};
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .body_cb = stream_cb,
+        .body_ctx = &ctx,
+    };
+    assert(req.headers);
+
+    assert(stream_parse(&req, data, STREAM_MAX_BYTES_PER_READ) == PARSE_OK);
+    assert(req.body_len == STREAM_BODY_SIZE);
+    assert(ctx.received == STREAM_BODY_SIZE);
+
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_stream_invalid_limit(void) {
+    char *body;
+    char *data = stream_request(STREAM_BODY_SIZE, &body);
+
+    stream_ctx_t ctx = {.expected = body, .received = 0, .status = PARSE_OK};
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .body_cb = stream_cb,
+        .body_ctx = &ctx,
+        .body_limit = STREAM_BODY_SIZE - 1,
+    };
+    assert(req.headers);
+
+    assert(stream_parse(&req, data, STREAM_MAX_BYTES_PER_READ) ==
+           PARSE_TOO_LARGE);
+    assert(ctx.received == 0);
+
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_stream_callback_abort(void) {
+    char *body;
+    char *data = stream_request(STREAM_BODY_SIZE, &body);
+
+    stream_ctx_t ctx = {.expected = body, .received = 0, .status = PARSE_ERR};
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .body_cb = stream_cb,
+        .body_ctx = &ctx,
+    };
+    assert(req.headers);
+
+    assert(stream_parse(&req, data, STREAM_MAX_BYTES_PER_READ) == PARSE_ERR);
+    assert(ctx.received > 0 && ctx.received < STREAM_BODY_SIZE);
+
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_chunked_valid(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Transfer-Encoding: Chunked\r\n"
+        "\r\n"
+        "7\r\n"
+        "Hello, \r\n"
+        "6;ext=\"a;b\"\r\n"
+        "World!\r\n"
+        "0\r\n"
+        "Expires: never\r\n"
+        "\r\n";
+
+    assert(stream_parse(&req, data, MAX_BYTES_PER_READ) == PARSE_OK);
+    assert(req.body_len == 13);
+    assert(strcmp(req.body, "Hello, World!") == 0);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_chunked_stream_large(void) {
+    char *body;
+    char *data = chunked_request(STREAM_BODY_SIZE, &body);
+
+    stream_ctx_t ctx = {.expected = body, .received = 0, .status = PARSE_OK};
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .body_cb = stream_cb,
+        .body_ctx = &ctx,
+    };
+    assert(req.headers);
+
+    assert(stream_parse(&req, data, STREAM_MAX_BYTES_PER_READ) == PARSE_OK);
+    assert(req.body_len == STREAM_BODY_SIZE);
+    assert(ctx.received == STREAM_BODY_SIZE);
+
+    free(body);
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_chunked_invalid(void) {
+    char *invalid[] = {
+        // Missing last chunk.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\nHello\r\n",
+        // Chunk data longer than its size.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "3\r\nHello\r\n0\r\n\r\n",
+        // Chunk size without hex digits.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "\r\n0\r\n\r\n",
+        // Chunk size overflowing.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "10000000000000000\r\n0\r\n\r\n",
+        // Bare LF ending the chunk size line.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\nHello\r\n0\r\n\r\n",
+        // Both framings present.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n"
+        "Content-Length: 5\r\n\r\n"
+        "5\r\nHello\r\n0\r\n\r\n",
+        // Unsupported transfer coding.
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+        "0\r\n\r\n",
+    };
+
+    for (size_t i = 0; i < sizeof invalid / sizeof *invalid; ++i) {
+        request_t req = {
+            .request_line = {0},
+            .headers = hash_table_init(64, NULL),
+        };
+        assert(req.headers);
+
+        assert(stream_parse(&req, invalid[i], MAX_BYTES_PER_READ) ==
+               PARSE_INVALID);
+
+        hash_table_free(req.headers);
+    }
+
+    // Decoded body too large for the buffer.
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char too_large[] =
+        "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "800\r\n";
+    assert(stream_parse(&req, too_large, MAX_BYTES_PER_READ) ==
+           PARSE_TOO_LARGE);
+
+    hash_table_free(req.headers);
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_single_chunk(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 13\r\n"
+        "\r\n"
+        "Hello, World!";
+
+    // Complete request is parsed without waiting for the end of the stream.
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+    assert(req.request_line.method == POST);
+    assert(strcmp(req.request_line.request_target, "/submit") == 0);
+    assert(strcmp(req.known_headers[HEADER_HOST], "example.com") == 0);
+    assert(strcmp(req.body, "Hello, World!") == 0);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_single_chunk_partial(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char head[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 13\r\n"
+        "\r\n"
+        "Hello";
+    char rest[] = ", World!";
+
+    assert(request_parse(&req, head, strlen(head)) == PARSE_INCOMPLETE);
+    assert(request_parse(&req, rest, strlen(rest)) == PARSE_OK);
+    assert(strcmp(req.body, "Hello, World!") == 0);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_content_length_forms(void) {
+    struct {
+        char *fields;
+        int status;
+    } cases[] = {
+        {"Content-Length: 5\r\n", PARSE_OK},
+        {"Content-Length: 0005\r\n", PARSE_OK},
+        // Lists of identical values count as one.
+        {"Content-Length: 5,5\r\n", PARSE_OK},
+        {"Content-Length: 5\r\nContent-Length: 5\r\n", PARSE_OK},
+        {"Content-Length: +5\r\n", PARSE_INVALID},
+        {"Content-Length: -5\r\n", PARSE_INVALID},
+        {"Content-Length: 5 5\r\n", PARSE_INVALID},
+        {"Content-Length: 5, 6\r\n", PARSE_INVALID},
+        {"Content-Length: 5\r\nContent-Length: 6\r\n", PARSE_INVALID},
+        {"Content-Length: 0x5\r\n", PARSE_INVALID},
+        {"Content-Length: ,\r\n", PARSE_INVALID},
+        {"Content-Length: 18446744073709551621\r\n", PARSE_INVALID},
+        {"Content-Length: 2048\r\n", PARSE_TOO_LARGE},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+        request_t req = {
+            .request_line = {0},
+            .headers = hash_table_init(64, NULL),
+        };
+        assert(req.headers);
+
+        char buf[128];
+        int len = snprintf(buf, sizeof buf,
+                           "POST / HTTP/1.1\r\n%s\r\nHello", cases[i].fields);
+        assert(len > 0 && (size_t)len < sizeof buf);
+
+        assert(request_parse(&req, buf, (size_t)len) == cases[i].status);
+        if (cases[i].status == PARSE_OK) {
+            assert(req.body_len == 5 && strcmp(req.body, "Hello") == 0);
+        }
+
+        hash_table_free(req.headers);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+// Parse `data` as `stream_parse` does, answering each (PARSE_CONTINUE) by
+// counting it in `continues`.
+static int expect_parse(request_t *req, char *data, size_t *continues) {
+    chunk_reader_t reader = {
+        .data = data,
+        .bytes_per_read = 1,
+        .pos = 0,
+    };
+
+    char buf[MAX_BYTES_PER_READ + 1];
+
+    int status;
+    size_t bytes_read;
+    while (1) {
+        reader.bytes_per_read = (size_t)((rand() % MAX_BYTES_PER_READ) + 1);
+
+        bytes_read = chunk_reader_read(&reader, buf, sizeof buf);
+        if (bytes_read == 0) {
+            while ((status = request_parse(req, "", 0)) == PARSE_INCOMPLETE);
+        } else {
+            status = request_parse(req, buf, bytes_read);
+        }
+
+        if (status == PARSE_CONTINUE) {
+            (*continues)++;
+            continue;
+        }
+
+        if (status != PARSE_INCOMPLETE || bytes_read == 0) {
+            break;
+        }
+    }
+
+    return status;
+}
+
+void test_request_body_expect_continue(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char head[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 13\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n";
+    char body[] = "Hello, World!";
+
+    // Head is reported before any of the body is sent.
+    assert(request_parse(&req, head, strlen(head)) == PARSE_CONTINUE);
+    assert(request_parse(&req, body, strlen(body)) == PARSE_OK);
+    assert(strcmp(req.body, "Hello, World!") == 0);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_expect_continue_fragmented(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    size_t continues = 0;
+    char data[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 13\r\n"
+        "Expect: 100-Continue\r\n"
+        "\r\n"
+        "Hello, World!";
+
+    assert(expect_parse(&req, data, &continues) == PARSE_OK);
+    assert(strcmp(req.body, "Hello, World!") == 0);
+
+    // No interim response is asked for if the body arrived with the head.
+    assert(continues <= 1);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_expect_rejected(void) {
+    struct {
+        char *data;
+        int status;
+    } cases[] = {
+        {"POST / HTTP/1.1\r\nContent-Length: 4096\r\n"
+         "Expect: 100-continue\r\n\r\n",
+         PARSE_TOO_LARGE},
+        {"POST / HTTP/1.1\r\nContent-Length: 5\r\n"
+         "Expect: 200-ok\r\n\r\n",
+         PARSE_EXPECTATION_FAILED},
+        // Nothing to wait for without a body.
+        {"POST / HTTP/1.1\r\nContent-Length: 0\r\n"
+         "Expect: 100-continue\r\n\r\n",
+         PARSE_OK},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+        request_t req = {
+            .request_line = {0},
+            .headers = hash_table_init(64, NULL),
+        };
+        assert(req.headers);
+
+        size_t continues = 0;
+        assert(expect_parse(&req, cases[i].data, &continues) ==
+               cases[i].status);
+        assert(continues == 0);
+
+        hash_table_free(req.headers);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_body_expect_continue_aborted(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char head[] =
+        "POST /submit HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Content-Length: 30\r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n";
+
+    // Client disconnects after the interim response, before the body.
+    assert(request_parse(&req, head, strlen(head)) == PARSE_CONTINUE);
+    request_parse_reset();
+    hash_table_free(req.headers);
+
+    request_t next = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(next.headers);
+
+    char data[] =
+        "GET /secret HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "\r\n";
+
+    assert(request_parse(&next, data, strlen(data)) == PARSE_OK);
+    assert(next.request_line.method == GET);
+    assert(strcmp(next.request_line.request_target, "/secret") == 0);
+    assert(next.body_len == 0);
+
+    hash_table_free(next.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_request_body_all(void) {
     test_request_body_valid();
     test_request_body_valid_truncated();
@@ -396,4 +942,17 @@ void test_request_body_all(void) {
     test_request_body_invalid_short_body();
     test_request_body_valid_no_content_length_with_body();
     test_request_body_invalid_content_length();
+    test_request_body_stream_large();
+    test_request_body_stream_invalid_limit();
+    test_request_body_stream_callback_abort();
+    test_request_body_chunked_valid();
+    test_request_body_chunked_stream_large();
+    test_request_body_chunked_invalid();
+    test_request_body_single_chunk();
+    test_request_body_single_chunk_partial();
+    test_request_body_content_length_forms();
+    test_request_body_expect_continue();
+    test_request_body_expect_continue_fragmented();
+    test_request_body_expect_rejected();
+    test_request_body_expect_continue_aborted();
 }
@@ -2,6 +2,61 @@
 
 #define MAX_BYTES_PER_READ 10
 
+#define LARGE_HEAD_FIELDS 24
+#define LARGE_HEAD_VALUE_SIZE 500
+#define LARGE_HEAD_MAX_BYTES_PER_READ 1024
+
+// Build a request with `LARGE_HEAD_FIELDS` headers, each with a value of
+// `LARGE_HEAD_VALUE_SIZE` bytes.
+static char *large_head_request(void) {
+    size_t cap = 64 + LARGE_HEAD_FIELDS * (LARGE_HEAD_VALUE_SIZE + 16);
+    char *data = malloc(cap);
+    assert(data);
+
+    size_t len = (size_t)snprintf(data, cap, "GET / HTTP/1.1\r\n");
+    for (size_t i = 0; i < LARGE_HEAD_FIELDS; ++i) {
+        len += (size_t)snprintf(data + len, cap - len, "X-Field-%zu: ", i);
+        memset(data + len, 'a' + (int)i, LARGE_HEAD_VALUE_SIZE);
+        len += LARGE_HEAD_VALUE_SIZE;
+        len += (size_t)snprintf(data + len, cap - len, "\r\n");
+    }
+
+    len += (size_t)snprintf(data + len, cap - len, "\r\n");
+    assert(len < cap);
+
+    return data;
+}
+
+static int large_head_parse(request_t *req, char *data) {
+    chunk_reader_t reader = {
+        .data = data,
+        .bytes_per_read = 1,
+        .pos = 0,
+    };
+
+    char buf[LARGE_HEAD_MAX_BYTES_PER_READ + 1];
+
+    int status;
+    size_t bytes_read;
+    while (1) {
+        reader.bytes_per_read =
+            (size_t)((rand() % LARGE_HEAD_MAX_BYTES_PER_READ) + 1);
+
+        bytes_read = chunk_reader_read(&reader, buf, sizeof buf);
+        if (bytes_read == 0) {
+            while ((status = request_parse(req, "", 0)) == PARSE_INCOMPLETE);
+            break;
+        }
+
+        if ((status = request_parse(req, buf, bytes_read)) !=
+            PARSE_INCOMPLETE) {
+            break;
+        }
+    }
+
+    return status;
+}
+
 void test_request_headers_valid_single(void) {
     request_t req = {
         .request_line = {0},
@@ -49,8 +104,7 @@ void test_request_headers_valid_single(void) {
     }
 
     assert(status == PARSE_OK);
-    assert(strcmp(hash_table_lookup(req.headers, "host"), "localhost:4040") ==
-           0);
+    assert(strcmp(req.known_headers[HEADER_HOST], "localhost:4040") == 0);
 
     hash_table_free(req.headers);
     printf("[PASS] %s\n", __func__);
@@ -106,12 +160,10 @@ void test_request_headers_valid_multiple(void) {
     }
 
     assert(status == PARSE_OK);
-    assert(strcmp(hash_table_lookup(req.headers, "host"), "example.com") == 0);
-    assert(strcmp(hash_table_lookup(req.headers, "user-agent"),
-                  "Mozilla/5.0") == 0);
-    assert(strcmp(hash_table_lookup(req.headers, "accept"), "text/html") == 0);
-    assert(strcmp(hash_table_lookup(req.headers, "connection"), "keep-alive") ==
-           0);
+    assert(strcmp(req.known_headers[HEADER_HOST], "example.com") == 0);
+    assert(strcmp(req.known_headers[HEADER_USER_AGENT], "Mozilla/5.0") == 0);
+    assert(strcmp(req.known_headers[HEADER_ACCEPT], "text/html") == 0);
+    assert(strcmp(req.known_headers[HEADER_CONNECTION], "keep-alive") == 0);
 
     hash_table_free(req.headers);
     printf("[PASS] %s\n", __func__);
@@ -166,7 +218,7 @@ void test_request_headers_valid_spacing(void) {
     }
 
     assert(status == PARSE_OK);
-    assert(strcmp(hash_table_lookup(req.headers, "host"), "example.com") == 0);
+    assert(strcmp(req.known_headers[HEADER_HOST], "example.com") == 0);
 
     hash_table_free(req.headers);
     printf("[PASS] %s\n", __func__);
@@ -542,7 +594,7 @@ void test_request_headers_valid_duplicate_header(void) {
     }
 
     assert(status == PARSE_OK);
-    assert(strcmp(hash_table_lookup(req.headers, "host"), "example.com") == 0);
+    assert(strcmp(req.known_headers[HEADER_HOST], "example.com") == 0);
     assert(strcmp(hash_table_lookup(req.headers, "cookie"), "1a, 1b") == 0);
 
     hash_table_free(req.headers);
@@ -981,6 +1033,170 @@ void test_request_headers_invalid_headers_limit(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_request_headers_valid_large_head(void) {
+    char *data = large_head_request();
+
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .head_limit = 4 * HEAD_LIMIT,
+    };
+    assert(req.headers);
+
+    assert(large_head_parse(&req, data) == PARSE_OK);
+    assert(req.headers->size == LARGE_HEAD_FIELDS);
+
+    char *value = hash_table_lookup(req.headers, "x-field-23");
+    assert(value && strlen(value) == LARGE_HEAD_VALUE_SIZE);
+    assert(value[0] == 'a' + 23);
+
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_headers_invalid_head_limit(void) {
+    char *data = large_head_request();
+
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    assert(large_head_parse(&req, data) == PARSE_INVALID);
+
+    free(data);
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_headers_invalid_buffered_head_limit(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+        .head_limit = 64,
+    };
+    assert(req.headers);
+
+    // Many short lines in one chunk are rejected before they are buffered,
+    // not once enough of them were consumed.
+    char data[] = "GET / HTTP/1.1\r\nA: b\r\nA: b\r\nA: b\r\nA: b\r\n"
+                  "A: b\r\nA: b\r\nA: b\r\nA: b\r\nA: b\r\n";
+    assert(request_parse(&req, data, sizeof data - 1) == PARSE_INVALID);
+
+    // The start of the body may follow a head ending within the limit.
+    hash_table_reset(req.headers);
+
+    char head[] = "POST / HTTP/1.1\r\nContent-Length: 80\r\n";
+    char rest[] = "\r\n0123456789012345678901234567890123456789"
+                  "0123456789012345678901234567890123456789";
+
+    assert(request_parse(&req, head, sizeof head - 1) == PARSE_INCOMPLETE);
+
+    int status = request_parse(&req, rest, sizeof rest - 1);
+    while (status == PARSE_INCOMPLETE) {
+        status = request_parse(&req, "", 0);
+    }
+
+    assert(status == PARSE_OK);
+    assert(req.body_len == 80);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_headers_single_chunk(void) {
+    struct {
+        char *data;
+        int status;
+    } cases[] = {
+        {"GET / HTTP/1.1\r\nHost: example.com\r\n\r\n", PARSE_OK},
+        {"GET / HTTP/1.1\r\n\r\n", PARSE_OK},
+        {"\r\nGET / HTTP/1.1\r\n\r\n", PARSE_INVALID},
+        {"GET / HTTP/1.1\r\nHost : example.com\r\n\r\n", PARSE_INVALID},
+        {"GET / HTTP/1.1\r\nHost: exa\nmple.com\r\n\r\n", PARSE_INVALID},
+        {"GET / HTTP/1.1\r\nX-Malfor\r\nmed: value\r\n\r\n", PARSE_INVALID},
+        {"GET / HTTP/1.1\r\nContent-Length: 5\r\n\r\n", PARSE_INCOMPLETE},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+        request_t req = {
+            .request_line = {0},
+            .headers = hash_table_init(64, NULL),
+        };
+        assert(req.headers);
+
+        char buf[64];
+        size_t len = strlen(cases[i].data);
+        memcpy(buf, cases[i].data, len + 1);
+
+        assert(request_parse(&req, buf, len) == cases[i].status);
+
+        // Leave the parser ready for the next request.
+        if (cases[i].status == PARSE_INCOMPLETE) {
+            assert(request_parse(&req, "", 0) == PARSE_INVALID);
+        }
+
+        hash_table_free(req.headers);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_headers_valid_known_headers(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "GET / HTTP/1.1\r\n"
+        "HOST: example.com\r\n"
+        "Accept-Encoding: gzip\r\n"
+        "content-TYPE: text/plain\r\n"
+        "Content-Types: text/html\r\n"
+        "ACCEPT-encoding: br\r\n"
+        "\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+
+    // Known headers never reach the table.
+    assert(req.headers->size == 1);
+    assert(strcmp(req.known_headers[HEADER_HOST], "example.com") == 0);
+    assert(strcmp(req.known_headers[HEADER_CONTENT_TYPE], "text/plain") == 0);
+    assert(strcmp(req.known_headers[HEADER_ACCEPT_ENCODING], "gzip, br") ==
+           0);
+    assert(req.known_headers[HEADER_CONTENT_LENGTH] == NULL);
+
+    assert(strcmp(request_header(&req, "Accept-Encoding"), "gzip, br") == 0);
+    assert(strcmp(request_header(&req, "content-types"), "text/html") == 0);
+    assert(request_header(&req, "expect") == NULL);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_headers_invalid_duplicate_host(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "GET / HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "Host: example.org\r\n"
+        "\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_INVALID);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_request_headers_all(void) {
     test_request_headers_valid_single();
     test_request_headers_valid_multiple();
@@ -999,4 +1215,10 @@ void test_request_headers_all(void) {
     test_request_headers_invalid_value_characters();
     test_request_headers_invalid_name_characters();
     test_request_headers_invalid_headers_limit();
+    test_request_headers_valid_large_head();
+    test_request_headers_invalid_head_limit();
+    test_request_headers_invalid_buffered_head_limit();
+    test_request_headers_single_chunk();
+    test_request_headers_valid_known_headers();
+    test_request_headers_invalid_duplicate_host();
 }
@@ -1327,6 +1327,116 @@ void test_request_line_invalid_missing_request_target(void) {
     printf("[PASS] %s\n", __func__);
 }
 
+void test_request_line_valid_methods(void) {
+    struct {
+        char *data;
+        method_t method;
+    } cases[] = {
+        {"GET / HTTP/1.1\r\n\r\n", GET},
+        {"HEAD / HTTP/1.1\r\n\r\n", HEAD},
+        {"POST / HTTP/1.1\r\n\r\n", POST},
+        {"PUT / HTTP/1.1\r\n\r\n", PUT},
+        {"DELETE / HTTP/1.1\r\n\r\n", DELETE},
+        {"OPTIONS * HTTP/1.1\r\n\r\n", OPTIONS},
+        {"PATCH / HTTP/1.1\r\n\r\n", PATCH},
+        {"CONNECT example.com:443 HTTP/1.1\r\n\r\n", CONNECT},
+        {"TRACE / HTTP/1.1\r\n\r\n", TRACE},
+        // Methods are case-sensitive, and must match the whole token.
+        {"get / HTTP/1.1\r\n\r\n", UNKNOWN_METHOD},
+        {"GETS / HTTP/1.1\r\n\r\n", UNKNOWN_METHOD},
+        {"PATC / HTTP/1.1\r\n\r\n", UNKNOWN_METHOD},
+        {"GET / HTTP/1.0\r\n\r\n", UNKNOWN_METHOD},
+        {"GET / http/1.1\r\n\r\n", UNKNOWN_METHOD},
+    };
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+        request_t req = {
+            .request_line = {0},
+            .headers = hash_table_init(64, NULL),
+        };
+        assert(req.headers);
+
+        char buf[64];
+        size_t len = strlen(cases[i].data);
+        memcpy(buf, cases[i].data, len + 1);
+
+        int status = request_parse(&req, buf, len);
+        if (cases[i].method == UNKNOWN_METHOD) {
+            assert(status == PARSE_INVALID);
+        } else {
+            assert(status == PARSE_OK);
+            assert(req.request_line.method == cases[i].method);
+            assert(strcmp(req.request_line.version, "HTTP/1.1") == 0);
+        }
+
+        hash_table_free(req.headers);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_line_valid_query(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "GET /users/42?id=a%2Fb&&name=J+Doe&flag&empty=&id=2 HTTP/1.1\r\n"
+        "\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+
+    request_line_t *line = &req.request_line;
+    assert(line->path_len == strlen("/users/42"));
+    assert(strncmp(line->request_target, "/users/42", line->path_len) == 0);
+    assert(line->query_len == strlen("id=a%2Fb&&name=J+Doe&flag&empty=&id=2"));
+
+    // First of duplicate keys wins, with its value decoded.
+    const query_param_t *param = request_query_param(&req, "id");
+    assert(param && param->value_len == 3);
+    assert(strncmp(param->value, "a/b", 3) == 0);
+
+    // Decoding happens once.
+    assert(request_query_param(&req, "id") == param);
+    assert(param->value_len == 3);
+
+    param = request_query_param(&req, "name");
+    assert(param && param->value_len == 5);
+    assert(strncmp(param->value, "J Doe", 5) == 0);
+
+    param = request_query_param(&req, "flag");
+    assert(param && param->value_len == 0);
+
+    param = request_query_param(&req, "empty");
+    assert(param && param->value_len == 0);
+
+    assert(request_query_param(&req, "missing") == NULL);
+    assert(req.query_params_len == 5);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_request_line_valid_no_query(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] = "GET /index.html HTTP/1.1\r\n\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+    assert(req.request_line.path_len == strlen("/index.html"));
+    assert(req.request_line.query_len == 0);
+    assert(request_query_param(&req, "a") == NULL);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
 void test_request_line_all(void) {
     srand((unsigned)time(NULL));
 
@@ -1354,4 +1464,7 @@ void test_request_line_all(void) {
     test_request_line_invalid_cr_abuse();
     test_request_line_invalid_lfcr();
     test_request_line_invalid_missing_request_target();
+    test_request_line_valid_methods();
+    test_request_line_valid_query();
+    test_request_line_valid_no_query();
 }
@@ -0,0 +1,155 @@
+#include "test_uri.h"
+
+// Decode `in` into `buf`, returning it null-terminated.
+static char *decode(char *buf, const char *in, int plus_as_space) {
+    size_t len = strlen(in);
+    memcpy(buf, in, len + 1);
+
+    buf[uri_percent_decode(buf, len, plus_as_space)] = '\0';
+    return buf;
+}
+
+// Normalize `in` into `buf`, returning it null-terminated.
+static char *normalize(char *buf, const char *in) {
+    size_t len = strlen(in);
+    memcpy(buf, in, len + 1);
+
+    buf[uri_path_normalize(buf, len)] = '\0';
+    return buf;
+}
+
+void test_uri_percent_decode(void) {
+    char buf[128];
+
+    assert(strcmp(decode(buf, "", 0), "") == 0);
+    assert(strcmp(decode(buf, "/plain/path", 0), "/plain/path") == 0);
+    assert(strcmp(decode(buf, "%41%62%2f%2F", 0), "Ab//") == 0);
+    assert(strcmp(decode(buf, "a+b%20c", 0), "a+b c") == 0);
+    assert(strcmp(decode(buf, "a+b%20c", 1), "a b c") == 0);
+
+    // Malformed or truncated escapes are kept.
+    assert(strcmp(decode(buf, "100%", 0), "100%") == 0);
+    assert(strcmp(decode(buf, "%4", 0), "%4") == 0);
+    assert(strcmp(decode(buf, "%zz%41", 0), "%zzA") == 0);
+
+    // Escapes on both sides of the 16 byte blocks scanned at once.
+    assert(strcmp(decode(buf,
+                         "/items/0123456789ab%2Fcdef0123456789abcdef%2"
+                         "0xyz0123456789abcdef0123%41",
+                         0),
+                  "/items/0123456789ab/cdef0123456789abcdef xyz0123456789abc"
+                  "def0123A") == 0);
+
+    // Runs of escapes decoded five at a time, up to a malformed one.
+    assert(strcmp(decode(buf,
+                         "/id/%E4%B8%AD%e6%96%87%41%42%43%44%45%46%47%48%49"
+                         "%4a%4B%3:%:0%G1%g1%4/%/4%@1%`1%61%62%63%64%65%66",
+                         0),
+                  "/id/\xe4\xb8\xad\xe6\x96\x87"
+                  "ABCDEFGHIJK%3:%:0%G1%g1%4/%/4%@1%`1abcdef") == 0);
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_uri_path_normalize(void) {
+    struct {
+        const char *in;
+        const char *out;
+    } cases[] = {
+        {"/", "/"},
+        {"/a/b/c", "/a/b/c"},
+        {"/a/./b", "/a/b"},
+        {"/a/b/../c", "/a/c"},
+        {"/a/b/..", "/a/"},
+        {"/a/b/.", "/a/b/"},
+        {"/../../a", "/a"},
+        {"/..", "/"},
+        {"//a///b//", "/a/b/"},
+        {"/a/.hidden/..b/c.d", "/a/.hidden/..b/c.d"},
+        {"/a/b/c/./../../g", "/a/g"},
+        // Repeated slash straddling the 16 byte blocks scanned at once.
+        {"/0123456789abcd//0123456789abcdef",
+         "/0123456789abcd/0123456789abcdef"},
+        {"/0123456789abcde/0123456789abcdef/../x", "/0123456789abcde/x"},
+        {"*", "*"},
+    };
+
+    char buf[128];
+
+    for (size_t i = 0; i < sizeof cases / sizeof *cases; ++i) {
+        assert(strcmp(normalize(buf, cases[i].in), cases[i].out) == 0);
+    }
+
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_uri_request_path_normalize(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] =
+        "GET /api/./v1//users/%2e%2e/items/%41%42?id=x%2By&n=1 HTTP/1.1\r\n"
+        "\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+
+    // Query indexed before the path moves must stay valid.
+    const query_param_t *param = request_query_param(&req, "n");
+    assert(param && strncmp(param->value, "1", param->value_len) == 0);
+
+    assert(request_path_normalize(&req) == PARSE_OK);
+    assert(strcmp(req.request_line.request_target,
+                  "/api/v1/items/AB?id=x%2By&n=1") == 0);
+    assert(req.request_line.path_len == strlen("/api/v1/items/AB"));
+
+    param = request_query_param(&req, "n");
+    assert(param && strncmp(param->value, "1", param->value_len) == 0);
+    param = request_query_param(&req, "id");
+    assert(param && strncmp(param->value, "x+y", param->value_len) == 0);
+
+    hash_table_free(req.headers);
+
+    // A second call does not decode the path again.
+    req = (request_t){
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char twice[] = "GET /a/%2541 HTTP/1.1\r\n\r\n";
+
+    assert(request_parse(&req, twice, strlen(twice)) == PARSE_OK);
+    assert(request_path_normalize(&req) == PARSE_OK);
+    assert(request_path_normalize(&req) == PARSE_OK);
+    assert(strcmp(req.request_line.request_target, "/a/%41") == 0);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_uri_request_path_invalid_null(void) {
+    request_t req = {
+        .request_line = {0},
+        .headers = hash_table_init(64, NULL),
+    };
+    assert(req.headers);
+
+    char data[] = "GET /file%00.txt HTTP/1.1\r\n\r\n";
+
+    assert(request_parse(&req, data, strlen(data)) == PARSE_OK);
+    assert(request_path_normalize(&req) == PARSE_INVALID);
+    assert(request_path_normalize(&req) == PARSE_INVALID);
+
+    hash_table_free(req.headers);
+    printf("[PASS] %s\n", __func__);
+}
+
+void test_uri_all(void) {
+    test_uri_percent_decode();
+    test_uri_path_normalize();
+    test_uri_request_path_normalize();
+    test_uri_request_path_invalid_null();
+}
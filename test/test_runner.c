@@ -1,8 +1,10 @@
+#include "test_admission.h"
 #include "test_channel.h"
 #include "test_hash_table.h"
 #include "test_request_body.h"
 #include "test_request_headers.h"
 #include "test_request_line.h"
+#include "test_uri.h"
 
 int main(void) {
     printf("+-------------------+\n");
@@ -13,7 +15,12 @@ int main(void) {
     printf("+----------------------+\n");
     printf("|   HASH TABLE TESTS   |\n");
     printf("+----------------------+\n");
-    // test_hash_table_all();
+    test_hash_table_all();
+
+    printf("+---------------------+\n");
+    printf("|   ADMISSION TESTS   |\n");
+    printf("+---------------------+\n");
+    test_admission_all();
 
     printf("+--------------------------------+\n");
     printf("|   REQUEST LINE PARSING TESTS   |\n");
@@ -30,5 +37,10 @@ int main(void) {
     printf("+--------------------------------+\n");
     test_request_body_all();
 
+    printf("+---------------+\n");
+    printf("|   URI TESTS   |\n");
+    printf("+---------------+\n");
+    test_uri_all();
+
     return 0;
 }